@@ -7,8 +7,18 @@
 #include <thread>
 #include <variant>
 #include <unordered_set>
+#include <map>
+#include <span>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <string>
 #include "MatrixView.hpp"
 #include "getL1CacheSize.hpp"
+#include "fixed.hpp"
+#include "PackedMatrix.hpp"
+#include "trace.hpp"
+#include "sparsity.hpp"
 
 #undef min
 #undef max
@@ -21,11 +31,15 @@ class MatrixMultiplier
         using PreconditionTypeWithViews = std::function<bool(MatrixView, MatrixView, MatrixView)>;
         using PreconditionType = std::variant<PreconditionTypeWithSizes, PreconditionTypeWithViews>;
         using MultiplierType = std::function<void(const MatrixMultiplier&, MatrixView, MatrixView, MatrixView, MatMulMode)>;
+        using WorkspaceType = std::function<std::size_t(int, int, int, MatMulMode)>;
         PreconditionType precondition;
         MultiplierType multiplier;
+        std::string name;
+        WorkspaceType workspace; // bytes of scratch one call allocates itself (not its sub-multiplications), none if empty
 
-        Multiplier(MultiplierType multiplier) : Multiplier([](int, int, int) { return true; }, multiplier) {}
-        Multiplier(PreconditionType precondition, MultiplierType multiplier) : precondition(precondition), multiplier(multiplier) {}
+        Multiplier(MultiplierType multiplier, std::string name = "custom") : Multiplier([](int, int, int) { return true; }, multiplier, std::move(name)) {}
+        Multiplier(PreconditionType precondition, MultiplierType multiplier, std::string name = "custom", WorkspaceType workspace = {})
+            : precondition(precondition), multiplier(multiplier), name(std::move(name)), workspace(std::move(workspace)) {}
 
         bool can_call_precondition_with_sizes() const
         {
@@ -43,16 +57,73 @@ class MatrixMultiplier
         {
             return std::get<PreconditionTypeWithViews>(precondition)(A, B, C);
         }
+        std::size_t workspace_bytes(int n, int m, int p, MatMulMode mode) const
+        {
+            return workspace ? workspace(n, m, p, mode) : 0;
+        }
 
     };
 
+public:
+    static constexpr std::size_t no_memory_budget = SIZE_MAX;
+
+private:
     std::vector<Multiplier> multipliers{};
+    std::size_t memory_budget = no_memory_budget;
+
+    // Scratch reserved by the strategies running now, in every thread and multiplier
+    inline static std::atomic<std::size_t> scratch_in_use = 0;
+
+    // Reserves bytes of scratch_in_use if that keeps it within budget, until destroyed
+    class WorkspaceReservation
+    {
+        std::size_t bytes = 0;
+        bool reserved = false;
+
+    public:
+        WorkspaceReservation(std::size_t bytes, std::size_t budget)
+        {
+            std::size_t used = scratch_in_use.load(std::memory_order_relaxed);
+            do
+            {
+                if (bytes > budget || used > budget - bytes)
+                    return;
+            } while (!scratch_in_use.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+            this->bytes = bytes;
+            reserved = true;
+        }
+        ~WorkspaceReservation()
+        {
+            if (reserved) scratch_in_use.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+
+        explicit operator bool() const { return reserved; }
+
+        WorkspaceReservation(const WorkspaceReservation&) = delete;
+        WorkspaceReservation& operator=(const WorkspaceReservation&) = delete;
+    };
 
     static bool valid_for_multiplying(MatrixView A, MatrixView B, MatrixView C)
     {
         return A.col_count() == B.row_count() && B.col_count() == C.col_count() && A.row_count() == C.row_count();
     }
 
+    // A strategy whose workspace doesn't fit into the budget next to the scratch of everything running now
+    // leaves the multiplication to the next strategy of the chain that accepts it
+    void call(const Multiplier& multiplier, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode) const
+    {
+        WorkspaceReservation reservation(multiplier.workspace_bytes(A.row_count(), A.col_count(), B.col_count(), mode), memory_budget);
+        if (!reservation)
+        {
+            if (auto next = find_strategy(A, B, C, &multiplier + 1))
+                call(*next, A, B, C, mode);
+            return;
+        }
+
+        trace::Scope scope(multiplier.name, A.row_count(), A.col_count(), B.col_count());
+        multiplier.multiplier(*this, A, B, C, mode);
+    }
+
 public:
     void naive_iterative(MatrixView A, MatrixView B, MatrixView C, MatMulMode mode) const
     { 
@@ -66,50 +137,85 @@ public:
                     C(i, j) += A(i, k) * B(k, j);
     }
 
+    // In Overwrite mode the first row of B overwrites the row of C instead of a separate clearing pass
     void naive_cache_friendly_iterative(MatrixView A, MatrixView B, MatrixView C, MatMulMode mode) const
     {
-        if (mode == MatMulMode::Overwrite)
-            C.clear();
-
         int n = A.row_count(), m = A.col_count(), p = B.col_count();
+        if (m == 0)
+        {
+            if (mode == MatMulMode::Overwrite)
+                C.clear();
+            return;
+        }
+
         for (int i = 0; i < n; i++)
-            for (int k = 0; k < m; k++)
+        {
+            int k = 0;
+            if (mode == MatMulMode::Overwrite)
+            {
+                for (int j = 0; j < p; j++)
+                    C(i, j) = A(i, 0) * B(0, j);
+                k = 1;
+            }
+            for (; k < m; k++)
                 for (int j = 0; j < p; j++)
                     C(i, j) += A(i, k) * B(k, j);
+        }
     }
 
     struct BlockedMultiplier
     {
         int block_size;
+        // The first block product of each block of C is multiplied in the caller's mode, so Overwrite needs no
+        // clearing. Products with a zero block of an indexed operand (see sparsity.hpp) are skipped, blocks of C
+        // left without any are cleared in Overwrite mode.
         void operator()(const MatrixMultiplier& mult, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
         {
-            if (mode == MatMulMode::Overwrite)
-                C.clear();
-
             int n = A.row_count(), m = A.col_count(), p = B.col_count();
+            std::vector<char> written((p + block_size - 1) / block_size);
 
-            for (int i = 0; i < n; i += block_size)            
-                for (int k = 0; k < m; k += block_size)                    
-                    for (int j = 0; j < p; j += block_size)                
-                        mult(A.getSubMatrix(i, std::min(i + block_size, n), k, std::min(k + block_size, m)),
-                            B.getSubMatrix(k, std::min(k + block_size, m), j, std::min(j + block_size, p)),
-                            C.getSubMatrix(i, std::min(i + block_size, n), j, std::min(j + block_size, p)), MatMulMode::Add);
+            for (int i = 0; i < n; i += block_size)
+            {
+                std::ranges::fill(written, mode == MatMulMode::Add);
+                for (int k = 0; k < m; k += block_size)
+                {
+                    MatrixView A_block = A.getSubMatrix(i, std::min(i + block_size, n), k, std::min(k + block_size, m));
+                    if (sparsity::is_zero(A_block))
+                        continue;
+                    for (int j = 0; j < p; j += block_size)
+                    {
+                        MatrixView B_block = B.getSubMatrix(k, std::min(k + block_size, m), j, std::min(j + block_size, p));
+                        if (sparsity::is_zero(B_block))
+                            continue;
+                        mult(A_block, B_block, C.getSubMatrix(i, std::min(i + block_size, n), j, std::min(j + block_size, p)),
+                             written[j / block_size] ? MatMulMode::Add : MatMulMode::Overwrite);
+                        written[j / block_size] = true;
+                    }
+                }
+                for (int j = 0; j < p; j += block_size)
+                    if (!written[j / block_size])
+                        C.getSubMatrix(i, std::min(i + block_size, n), j, std::min(j + block_size, p)).clear();
+            }
         }
     };
 
     void recursive(MatrixView A, MatrixView B, MatrixView C, MatMulMode mode) const
     {
-        if (A.row_count() == 0 || A.col_count() == 0 || B.col_count() == 0) // Empty matrices
+        int n = A.row_count(), m = A.col_count(), p = B.col_count();
+        if (n == 0 || p == 0) // Empty matrices
             return;
 
-        if (mode == MatMulMode::Overwrite)
-            C.clear();
-    
-        int n = A.row_count(), m = A.col_count(), p = B.col_count();
+        if (m == 0) // A zero product
+        {
+            if (mode == MatMulMode::Overwrite)
+                C.clear();
+            return;
+        }
     
         if (n == m && m == p && p == 1) // base case
         {
-            C(0, 0) += A(0, 0) * B(0, 0);
+            if (mode == MatMulMode::Overwrite) C(0, 0)  = A(0, 0) * B(0, 0);
+            else                               C(0, 0) += A(0, 0) * B(0, 0);
             return;
         }
     
@@ -128,31 +234,58 @@ public:
         MatrixView C21 = C.getSubMatrix(n / 2, n    , 0    , p / 2);
         MatrixView C22 = C.getSubMatrix(n / 2, n    , p / 2, p    );
     
-        (*this)(A11, B11, C11, MatMulMode::Add);
-        (*this)(A12, B21, C11, MatMulMode::Add);
-        (*this)(A11, B12, C12, MatMulMode::Add);
-        (*this)(A12, B22, C12, MatMulMode::Add);
-        (*this)(A21, B11, C21, MatMulMode::Add);
-        (*this)(A22, B21, C21, MatMulMode::Add);
-        (*this)(A21, B12, C22, MatMulMode::Add);
-        (*this)(A22, B22, C22, MatMulMode::Add);
+        sum_of_products(A12, B21, A11, B11, C11, mode);
+        sum_of_products(A12, B22, A11, B12, C12, mode);
+        sum_of_products(A22, B21, A21, B11, C21, mode);
+        sum_of_products(A22, B22, A21, B12, C22, mode);
     }
 
+    // C = A1 * B1 + A2 * B2 (or C += ...) for the quadrants of the recursive splits. Products with an empty or
+    // zero (see sparsity.hpp) part are skipped, the first one left is multiplied in the caller's mode, and C is
+    // cleared in Overwrite mode if none is left.
+    void sum_of_products(MatrixView A1, MatrixView B1, MatrixView A2, MatrixView B2, MatrixView C, MatMulMode mode) const
+    {
+        bool written = mode == MatMulMode::Add;
+        for (auto [A, B] : {std::pair{A1, B1}, std::pair{A2, B2}})
+            if (!sparsity::is_zero(A) && !sparsity::is_zero(B))
+            {
+                (*this)(A, B, C, written ? MatMulMode::Add : MatMulMode::Overwrite);
+                written = true;
+            }
+        if (!written)
+            C.clear();
+    }
+
+    // Splits C into quadrants and computes them on up to 4 threads. The thread_count threads of the top level
+    // split are shared between its quadrants, so nested splits (through the chain) never use more in total.
     struct MultithreadedRecursiveMultiplier
     {
-        void operator()(const MatrixMultiplier& mult, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+        int thread_count = std::thread::hardware_concurrency();
+
+        inline static thread_local int inherited_budget = 0; // share of the enclosing split, 0 outside of one
+
+        int budget() const
         {
-            if (A.row_count() == 0 || A.col_count() == 0 || B.col_count() == 0) // Empty matrices
-            return;
+            return inherited_budget ? inherited_budget : thread_count;
+        }
 
-            if (mode == MatMulMode::Overwrite)
-                C.clear();
-    
+        void operator()(const MatrixMultiplier& mult, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+        {
             int n = A.row_count(), m = A.col_count(), p = B.col_count();
+            if (n == 0 || p == 0) // Empty matrices
+                return;
+
+            if (m == 0) // A zero product
+            {
+                if (mode == MatMulMode::Overwrite)
+                    C.clear();
+                return;
+            }
         
             if (n == m && m == p && p == 1) // base case
             {
-                C(0, 0) += A(0, 0) * B(0, 0);
+                if (mode == MatMulMode::Overwrite) C(0, 0)  = A(0, 0) * B(0, 0);
+                else                               C(0, 0) += A(0, 0) * B(0, 0);
                 return;
             }
         
@@ -171,32 +304,159 @@ public:
             MatrixView C21 = C.getSubMatrix(n / 2, n    , 0    , p / 2);
             MatrixView C22 = C.getSubMatrix(n / 2, n    , p / 2, p    );
         
+            std::array<std::function<void()>, 4> parts{
+                [&]{ mult.sum_of_products(A12, B21, A11, B11, C11, mode); },
+                [&]{ mult.sum_of_products(A12, B22, A11, B12, C12, mode); },
+                [&]{ mult.sum_of_products(A22, B21, A21, B11, C21, mode); },
+                [&]{ mult.sum_of_products(A22, B22, A21, B12, C22, mode); }
+            };
+
+            // Multiply-adds of the non-zero tiles, estimated from the densities of the indexed operands
+            auto work_of = [](MatrixView A, MatrixView B)
+            {
+                return double(A.row_count()) * A.col_count() * B.col_count() * sparsity::density(A) * sparsity::density(B);
+            };
+            std::array<double, 4> work{
+                work_of(A12, B21) + work_of(A11, B11),
+                work_of(A12, B22) + work_of(A11, B12),
+                work_of(A22, B21) + work_of(A21, B11),
+                work_of(A22, B22) + work_of(A21, B12)
+            };
+
+            int budget = this->budget();
+            int workers = std::clamp(budget, 1, std::max(int(std::ranges::count_if(work, [](double w) { return w > 0; })), 1));
+            if (mult.memory_budget != no_memory_budget)
+            {
+                // Parts running at the same time hold their scratch at the same time
+                std::size_t part = mult.workspace_bound(n - n / 2, m - m / 2, p - p / 2, MatMulMode::Add);
+                if (part > 0)
+                    workers = int(std::clamp<std::size_t>(mult.free_memory() / part, 1, workers));
+            }
+
+            // Largest part first to the least loaded worker
+            std::array<int, 4> order{0, 1, 2, 3};
+            std::ranges::stable_sort(order, std::greater{}, [&](int part) { return work[part]; });
+            std::vector<std::vector<int>> assigned(workers);
+            std::vector<double> load(workers, 0);
+            for (int part : order)
+            {
+                int worker = int(std::ranges::min_element(load) - load.begin());
+                assigned[worker].push_back(part);
+                load[worker] += work[part];
+            }
+
+            int trace_node = trace::current_node();
+            auto run = [&](int worker)
+            {
+                trace::Adopt adopt(trace_node);
+                int outer_budget = inherited_budget;
+                inherited_budget = budget / workers + (worker < budget % workers ? 1 : 0);
+                for (int part : assigned[worker])
+                    parts[part]();
+                inherited_budget = outer_budget;
+            };
+
             std::vector<std::thread> threads;
-            std::vector<std::array<MatrixView, 3>> parts_to_do_in_this_thread;
-            threads.reserve(3);
-            threads.push_back(std::thread([&]() 
-            { 
-                mult(A11, B11, C11, MatMulMode::Add); 
-                mult(A12, B21, C11, MatMulMode::Add); 
-            }));
-            threads.push_back(std::thread([&]() 
-            { 
-                mult(A11, B12, C12, MatMulMode::Add);
-                mult(A12, B22, C12, MatMulMode::Add);
-            }));
-            threads.push_back(std::thread([&]() 
-            { 
-                mult(A21, B11, C21, MatMulMode::Add); 
-                mult(A22, B21, C21, MatMulMode::Add); 
-            }));
-
-            mult(A21, B12, C22, MatMulMode::Add); 
-            mult(A22, B22, C22, MatMulMode::Add); 
+            threads.reserve(workers - 1);
+            for (int worker = 1; worker < workers; worker++)
+                threads.emplace_back(run, worker);
+
+            run(0);
 
             for (auto& thread : threads) thread.join();
         }
     };
 
+    // Matrix-vector (p == 1) and vector-matrix (n == 1) products. Both only stream A or B once, so they
+    // work on contiguous rows and split the rows (or the columns of C) between threads when it pays off.
+    struct VectorMultiplier
+    {
+        int thread_count;
+
+        static constexpr int min_elements_per_thread = 1 << 16;
+
+        void operator()(const MatrixMultiplier&, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+        {
+            int n = A.row_count(), m = A.col_count(), p = B.col_count();
+            if (n == 0 || p == 0)
+                return;
+
+            if (m == 0)
+            {
+                if (mode == MatMulMode::Overwrite)
+                    C.clear();
+                return;
+            }
+
+            // Inside a multithreaded split only its share of the threads
+            int budget = MultithreadedRecursiveMultiplier::inherited_budget;
+            int allowed = budget ? std::min(thread_count, budget) : thread_count;
+            int threads = std::clamp(int(std::int64_t(n) * m * p / min_elements_per_thread), 1, std::max(allowed, 1));
+
+            if (p == 1)
+            {
+                std::vector<int> x(m);
+                trace::scratch(x.size() * sizeof(int));
+                for (int k = 0; k < m; k++)
+                    x[k] = B(k, 0);
+                cachesim::access(x.data(), m * sizeof(int), true);
+
+                parallel_for(n, threads, [&](int begin, int end)
+                {
+                    for (int i = begin; i < end; i++)
+                    {
+                        const int* a = A.pointer(i, 0);
+                        cachesim::access(a, m * sizeof(int), false);
+                        cachesim::access(x.data(), m * sizeof(int), false);
+                        int sum = 0;
+                        for (int k = 0; k < m; k++)
+                            sum += a[k] * x[k];
+
+                        if (mode == MatMulMode::Overwrite) C(i, 0)  = sum;
+                        else                               C(i, 0) += sum;
+                    }
+                });
+            }
+            else
+            {
+                parallel_for(p, threads, [&](int begin, int end)
+                {
+                    int* c = C.pointer(0, 0);
+                    if (mode == MatMulMode::Overwrite)
+                        std::fill(c + begin, c + end, 0);
+
+                    for (int k = 0; k < m; k++)
+                    {
+                        int a = A(0, k);
+                        const int* b = B.pointer(k, 0);
+                        cachesim::access(b + begin, (end - begin) * sizeof(int), false);
+                        cachesim::access(c + begin, (end - begin) * sizeof(int), true);
+                        for (int j = begin; j < end; j++)
+                            c[j] += a * b[j];
+                    }
+                });
+            }
+        }
+
+        template<class F>
+        static void parallel_for(int count, int threads, F f)
+        {
+            std::vector<std::thread> workers;
+            workers.reserve(threads - 1);
+            int trace_node = trace::current_node();
+            for (int t = 1; t < threads; t++)
+                workers.emplace_back([&f, trace_node](int begin, int end)
+                {
+                    trace::Adopt adopt(trace_node);
+                    f(begin, end);
+                }, int(std::int64_t(count) * t / threads), int(std::int64_t(count) * (t + 1) / threads));
+
+            f(0, count / threads);
+
+            for (auto& worker : workers) worker.join();
+        }
+    };
+
     void strassen(MatrixView A, MatrixView B, MatrixView C, MatMulMode mode) const
     {   
         int s = A.row_count();
@@ -208,16 +468,9 @@ public:
             return;
         }
 
-        std::vector<int> D_vec;
-        MatrixView D;
-        if (mode == MatMulMode::Add)
-        {
-            D_vec.resize(s * s);
-            D = MatrixView(D_vec, s);
-            std::swap(C, D);
-        }
-
-        std::vector<int> buffer(5 * s * s / 4);
+        // Overwrite keeps all 7 products but 4 in the quadrants of C, Add goes through one product buffer
+        std::vector<int> buffer((mode == MatMulMode::Add ? 3 : 5) * s * s / 4); // see strassen_workspace
+        trace::scratch(buffer.size() * sizeof(int));
 
         MatrixView A11 = A.getSubMatrix(0    , s / 2, 0    , s / 2);
         MatrixView A12 = A.getSubMatrix(0    , s / 2, s / 2, s    );
@@ -237,6 +490,39 @@ public:
         MatrixView x({buffer.begin() + 0 * s * s / 4, size_t(s * s / 4)}, s / 2);
         MatrixView y({buffer.begin() + 1 * s * s / 4, size_t(s * s / 4)}, s / 2);
         MatrixView u({buffer.begin() + 2 * s * s / 4, size_t(s * s / 4)}, s / 2);
+
+        if (mode == MatMulMode::Add)
+        {
+            add(A11, A22, x);
+            add(B11, B22, y);
+            (*this)(x, y, u, MatMulMode::Overwrite);
+            C11.add_eq(u);
+            C22.add_eq(u);
+            add(A21, A22, x);
+            (*this)(x, B11, u, MatMulMode::Overwrite);
+            C21.add_eq(u);
+            C22.rem_eq(u);
+            sub(B12, B22, x);
+            (*this)(A11, x, u, MatMulMode::Overwrite);
+            C12.add_eq(u);
+            C22.add_eq(u);
+            sub(B21, B11, x);
+            (*this)(A22, x, u, MatMulMode::Overwrite);
+            C11.add_eq(u);
+            C21.add_eq(u);
+            add(A11, A12, x);
+            (*this)(x, B22, u, MatMulMode::Overwrite);
+            C11.rem_eq(u);
+            C12.add_eq(u);
+            sub(A21, A11, x);
+            add(B11, B12, y);
+            (*this)(x, y, C22, MatMulMode::Add);
+            sub(A12, A22, x);
+            add(B21, B22, y);
+            (*this)(x, y, C11, MatMulMode::Add);
+            return;
+        }
+
         MatrixView v({buffer.begin() + 3 * s * s / 4, size_t(s * s / 4)}, s / 2);
         MatrixView w({buffer.begin() + 4 * s * s / 4, size_t(s * s / 4)}, s / 2);
 
@@ -265,92 +551,273 @@ public:
         C22.rem_eq(C21);
         C12.add_eq(w);
         C21.add_eq(v);
+    }
 
-        if (mode == MatMulMode::Add) D.add_eq(C);
+    static std::size_t strassen_workspace(int s, MatMulMode mode)
+    {
+        return std::size_t(mode == MatMulMode::Add ? 3 : 5) * s * s / 4 * sizeof(int);
     }
 
-    static MatrixMultiplier one_strategy(Multiplier::MultiplierType multiplier)
+    // name identifies the strategy in traces (see trace.hpp)
+    static MatrixMultiplier one_strategy(Multiplier::MultiplierType multiplier, std::string name = "custom")
     {
         MatrixMultiplier result{};
-        result.multipliers.push_back(Multiplier{multiplier});
+        result.multipliers.push_back(Multiplier{multiplier, std::move(name)});
+        return result;
+    }
+
+    // workspace reports the scratch the strategy allocates per call, for memory budgets
+    static MatrixMultiplier add_strategy(Multiplier::PreconditionType precondition, Multiplier::MultiplierType strategy, const MatrixMultiplier& multiplier, std::string name = "custom", Multiplier::WorkspaceType workspace = {})
+    {
+        MatrixMultiplier result{multiplier};
+        result.multipliers.insert(result.multipliers.begin(), Multiplier{precondition, strategy, std::move(name), std::move(workspace)});
         return result;
     }
 
-    static MatrixMultiplier add_strategy(Multiplier::PreconditionType precondition, Multiplier::MultiplierType strategy, const MatrixMultiplier& multiplier)
+    // Strategies that would take the scratch of all the running ones above bytes are skipped for the next
+    // ones of the chain, and multithreaded splits run fewer parts at the same time
+    static MatrixMultiplier with_memory_budget(std::size_t bytes, const MatrixMultiplier& multiplier)
     {
         MatrixMultiplier result{multiplier};
-        result.multipliers.insert(result.multipliers.begin(), Multiplier{precondition, strategy});
+        result.memory_budget = bytes;
         return result;
     }
 
-    static MatrixMultiplier possibly_multithreaded(Multiplier::PreconditionTypeWithSizes until, const MatrixMultiplier& multiplier)
+    // Splits between threads while until holds and the split still has more than one thread to use
+    static MatrixMultiplier possibly_multithreaded(Multiplier::PreconditionTypeWithSizes until, const MatrixMultiplier& multiplier, int thread_count = std::thread::hardware_concurrency())
+    {
+        return add_strategy([until, thread_count](int n, int m, int p){ return MultithreadedRecursiveMultiplier{thread_count}.budget() > 1 && until(n, m, p); },
+                            MultithreadedRecursiveMultiplier{thread_count},
+                            multiplier,
+                            "multithreaded");
+    }
+
+    static MatrixMultiplier vector_then(int thread_count, const MatrixMultiplier& multiplier)
     {
-        return add_strategy(until, 
-                            MultithreadedRecursiveMultiplier{},
-                            multiplier);
+        return add_strategy([](int n, int, int p){ return n == 1 || p == 1; },
+                            VectorMultiplier{thread_count},
+                            multiplier,
+                            "vector",
+                            [](int, int m, int p, MatMulMode){ return p == 1 ? m * sizeof(int) : 0; });
     }
 
     static MatrixMultiplier into_blocks_then(int block_size, const MatrixMultiplier& multiplier)
     {
-        return add_strategy([block_size](int n, int m, int p){ return n > block_size && m > block_size && p > block_size; },
+        return add_strategy([block_size](int n, int m, int p){ return block_size > 0 && n > block_size && m > block_size && p > block_size; },
                             BlockedMultiplier{block_size},
-                            multiplier);
+                            multiplier,
+                            "blocked");
     }
 
+    // Strassen's products mix the quadrants, so operands with zero tiles (see sparsity.hpp) are left to the
+    // next strategies, which skip them
     static MatrixMultiplier strassen_then(Multiplier::PreconditionTypeWithSizes until, const MatrixMultiplier& multiplier)
     {
-        return add_strategy([until](int n, int m, int p){ return n == m && m == p && (n & (n - 1)) == 0 && until(n, m, p); },
+        return add_strategy(Multiplier::PreconditionTypeWithViews([until](MatrixView A, MatrixView B, MatrixView)
+                            {
+                                int n = A.row_count(), m = A.col_count(), p = B.col_count();
+                                return n == m && m == p && (n & (n - 1)) == 0 && until(n, m, p) && sparsity::density(A) == 1 && sparsity::density(B) == 1;
+                            }),
                             &MatrixMultiplier::strassen,
-                            multiplier);
+                            multiplier,
+                            "strassen",
+                            [](int n, int, int, MatMulMode mode){ return strassen_workspace(n, mode); });
     }
 
     static MatrixMultiplier recursive_then(Multiplier::PreconditionType until, const MatrixMultiplier& multiplier)
     {
-        return add_strategy(until, &MatrixMultiplier::recursive, multiplier);
+        return add_strategy(until, &MatrixMultiplier::recursive, multiplier, "recursive");
+    }
+
+    static MatrixMultiplier fixed_size_then(const MatrixMultiplier& multiplier)
+    {
+        return add_strategy([](int n, int m, int p){ return fixedSizeKernel(n, m, p) != nullptr; },
+                            [](const MatrixMultiplier&, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+                            {
+                                fixedSizeKernel(A.row_count(), A.col_count(), B.col_count())(A, B, C, mode);
+                            },
+                            multiplier,
+                            "fixed_size");
     }
 
     static MatrixMultiplier naive_iterative_mutliplier;
     static MatrixMultiplier naive_cache_friendly_mutliplier;
     static MatrixMultiplier full_recursive_mutliplier;
     static MatrixMultiplier cache_aware_blocked_multiplier;
-    static MatrixMultiplier hybrid_multiplier(int N, int M, int P)
+    static MatrixMultiplier hybrid_multiplier(int N, int M, int P, std::size_t memory_budget = no_memory_budget)
     {
         int max_power_of_2_less_than_NMP = 1 << (int)log2(std::min({N, M, P}));
-        return  into_blocks_then(max_power_of_2_less_than_NMP,
-                strassen_then ([](int n, int m, int p){ return n * m + m * p + n * p > getL1CacheSize() / sizeof(int); },
-                recursive_then([](int n, int m, int p){ return n * m + m * p + n * p > getL1CacheSize() / sizeof(int); },
+        size_t l1_elements = getL1CacheSize() / sizeof(int);
+        return  with_memory_budget(memory_budget,
+                vector_then(1,
+                into_blocks_then(max_power_of_2_less_than_NMP,
+                strassen_then ([l1_elements](int n, int m, int p){ return n * m + m * p + n * p > l1_elements; },
+                recursive_then([l1_elements](int n, int m, int p){ return n * m + m * p + n * p > l1_elements; },
+                fixed_size_then(
                 naive_cache_friendly_mutliplier
-        )));
+        ))))));
     }
 
-    static MatrixMultiplier multithreaded_hybrid_multiplier(int N, int M, int P)
+    // Parts below 128^3 multiplications aren't worth starting a thread for
+    static MatrixMultiplier multithreaded_hybrid_multiplier(int N, int M, int P, int thread_count = std::thread::hardware_concurrency(), std::size_t memory_budget = no_memory_budget)
     {
         int max_power_of_2_less_than_NMP = 1 << (int)log2(std::min({N, M, P}));
-        return  
-                possibly_multithreaded([N](int n, int, int){ return n > (N / 4 + 1); },
+        size_t l1_elements = getL1CacheSize() / sizeof(int);
+        return  with_memory_budget(memory_budget,
+                vector_then(thread_count,
+                possibly_multithreaded([](int n, int m, int p){ return std::int64_t(n) * m * p >= (1 << 21); },
                 into_blocks_then(max_power_of_2_less_than_NMP / 4,
-                strassen_then ([](int n, int m, int p){ return n * m + m * p + n * p > getL1CacheSize() / sizeof(int); },
-                recursive_then([](int n, int m, int p){ return n * m + m * p + n * p > getL1CacheSize() / sizeof(int); },
+                strassen_then ([l1_elements](int n, int m, int p){ return n * m + m * p + n * p > l1_elements; },
+                recursive_then([l1_elements](int n, int m, int p){ return n * m + m * p + n * p > l1_elements; },
+                fixed_size_then(
                 naive_cache_friendly_mutliplier
-        ))));
+        )))), thread_count)));
+    }
+
+    // First strategy (from `from` on, if given) whose precondition holds for A, B and C
+    const Multiplier* find_strategy(MatrixView A, MatrixView B, MatrixView C, const Multiplier* from = nullptr) const
+    {
+        if (!valid_for_multiplying(A, B, C))
+            return nullptr;
+
+        for (const Multiplier* multiplier = from ? from : multipliers.data(); multiplier != multipliers.data() + multipliers.size(); multiplier++)
+            if ((multiplier->can_call_precondition_with_sizes() && multiplier->precondition_with_sizes(A.row_count(), A.col_count(), B.col_count())) ||
+                (multiplier->can_call_precondition_with_views() && multiplier->precondition_with_views(A, B, C)))
+                return multiplier;
+
+        return nullptr;
+    }
+
+    // Most scratch any strategy of the chain allocates itself for one n x m x p multiplication
+    std::size_t workspace_bound(int n, int m, int p, MatMulMode mode) const
+    {
+        std::size_t bound = 0;
+        for (const auto& multiplier : multipliers)
+            bound = std::max(bound, multiplier.workspace_bytes(n, m, p, mode));
+        return bound;
+    }
+
+    // What the memory budget leaves next to the scratch of the running strategies
+    std::size_t free_memory() const
+    {
+        std::size_t used = scratch_in_use.load(std::memory_order_relaxed);
+        return memory_budget > used ? memory_budget - used : 0;
     }
 
     void operator()(MatrixView A, MatrixView B, MatrixView C, MatMulMode mode) const
     {
-        for (auto& multiplier : multipliers)
-            if (valid_for_multiplying(A, B, C) &&
-                ((multiplier.can_call_precondition_with_sizes() && multiplier.precondition_with_sizes(A.row_count(), A.col_count(), B.col_count())) ||
-                 (multiplier.can_call_precondition_with_views() && multiplier.precondition_with_views(A, B, C))))
+        if (auto multiplier = find_strategy(A, B, C))
+            call(*multiplier, A, B, C, mode);
+    }
+
+    // C = A * B with B prepared once by PackedMatrix. Every packed block of B is multiplied with the matching
+    // blocks of A by this multiplier while it is still in cache, the first block of each column of C
+    // uses mode and the rest accumulate.
+    void operator()(MatrixView A, const PackedMatrix& B, MatrixView C, MatMulMode mode) const
+    {
+        int n = A.row_count(), m = A.col_count(), p = B.col_count();
+        if (m != B.row_count() || C.row_count() != n || C.col_count() != p)
+            return;
+
+        if (m == 0)
+        {
+            if (mode == MatMulMode::Overwrite)
+                C.clear();
+            return;
+        }
+
+        int block_size = B.block_size();
+        for (int j = 0; j < p; j += block_size)
+            for (int k = 0; k < m; k += block_size)
             {
-                multiplier.multiplier(*this, A, B, C, mode);
-                return;
+                MatrixView B_block = B.block_at(k, j);
+                for (int i = 0; i < n; i += block_size)
+                    (*this)(A.getSubMatrix(i, std::min(i + block_size, n), k, k + B_block.row_count()),
+                            B_block,
+                            C.getSubMatrix(i, std::min(i + block_size, n), j, j + B_block.col_count()),
+                            k == 0 ? mode : MatMulMode::Add);
+            }
+    }
+
+    // Multiplies every {A, B, C} triple of the batch. Triples are grouped by shape and the strategy is
+    // chosen once per group (from its first triple), then the whole batch is split between the threads in
+    // contiguous runs of equal work. Each triple runs on one thread: multithreaded strategies inside it get a
+    // budget of one thread.
+    void batched(std::span<const std::array<MatrixView, 3>> batch, MatMulMode mode, int thread_count = std::thread::hardware_concurrency()) const
+    {
+        std::map<std::array<int, 3>, std::vector<std::size_t>> groups;
+        for (std::size_t i = 0; i < batch.size(); i++)
+        {
+            auto& [A, B, C] = batch[i];
+            if (valid_for_multiplying(A, B, C))
+                groups[{A.row_count(), A.col_count(), B.col_count()}].push_back(i);
+        }
+
+        std::vector<std::pair<const Multiplier*, std::size_t>> jobs;
+        jobs.reserve(batch.size());
+        for (auto& [shape, indices] : groups)
+        {
+            auto& [A, B, C] = batch[indices.front()];
+            const Multiplier* multiplier = find_strategy(A, B, C);
+            if (!multiplier) continue;
+            for (std::size_t i : indices)
+                jobs.emplace_back(multiplier, i);
+        }
+
+        std::vector<double> work{0}; // before each job, then the total
+        work.reserve(jobs.size() + 1);
+        for (auto [multiplier, i] : jobs)
+        {
+            auto& [A, B, C] = batch[i];
+            work.push_back(work.back() + double(A.row_count()) * A.col_count() * B.col_count());
+        }
+
+        int trace_node = trace::current_node();
+        auto run = [&](std::size_t begin, std::size_t end)
+        {
+            trace::Adopt adopt(trace_node);
+            int outer_budget = MultithreadedRecursiveMultiplier::inherited_budget;
+            MultithreadedRecursiveMultiplier::inherited_budget = 1;
+            for (std::size_t i = begin; i < end; i++)
+            {
+                auto& [A, B, C] = batch[jobs[i].second];
+                call(*jobs[i].first, A, B, C, mode);
             }
+            MultithreadedRecursiveMultiplier::inherited_budget = outer_budget;
+        };
+
+        // Thread t takes the jobs whose work starts in [total * t / threads, total * (t + 1) / threads)
+        int chunk_count = std::clamp<int>(thread_count, 1, int(std::max<std::size_t>(jobs.size(), 1)));
+        auto first_job = [&](int t)
+        {
+            if (t == chunk_count) return jobs.size(); // with the jobs of no work at the end
+            return std::size_t(std::ranges::lower_bound(work.begin(), work.end() - 1, work.back() * t / chunk_count) - work.begin());
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(chunk_count - 1);
+        for (int t = 1; t < chunk_count; t++)
+            threads.emplace_back(run, first_job(t), first_job(t + 1));
+
+        run(0, first_job(1));
+
+        for (auto& thread : threads) thread.join();
+    }
+
+    void batched(StridedMatrixBatch A, StridedMatrixBatch B, StridedMatrixBatch C, MatMulMode mode, int thread_count = std::thread::hardware_concurrency()) const
+    {
+        std::vector<std::array<MatrixView, 3>> batch;
+        int count = std::min({A.count, B.count, C.count});
+        batch.reserve(count);
+        for (int i = 0; i < count; i++)
+            batch.push_back({A[i], B[i], C[i]});
+
+        batched(batch, mode, thread_count);
     }
 };
 
-MatrixMultiplier MatrixMultiplier::naive_iterative_mutliplier{one_strategy(&MatrixMultiplier::naive_iterative)};
-MatrixMultiplier MatrixMultiplier::naive_cache_friendly_mutliplier{one_strategy(&MatrixMultiplier::naive_cache_friendly_iterative)};
-MatrixMultiplier MatrixMultiplier::full_recursive_mutliplier{one_strategy(&MatrixMultiplier::recursive)};
+MatrixMultiplier MatrixMultiplier::naive_iterative_mutliplier{one_strategy(&MatrixMultiplier::naive_iterative, "naive")};
+MatrixMultiplier MatrixMultiplier::naive_cache_friendly_mutliplier{one_strategy(&MatrixMultiplier::naive_cache_friendly_iterative, "naive_cf")};
+MatrixMultiplier MatrixMultiplier::full_recursive_mutliplier{one_strategy(&MatrixMultiplier::recursive, "recursive")};
 MatrixMultiplier MatrixMultiplier::cache_aware_blocked_multiplier(
     MatrixMultiplier::into_blocks_then(sqrt(getL1CacheSize() / sizeof(int) / 4),
     MatrixMultiplier::naive_cache_friendly_mutliplier));
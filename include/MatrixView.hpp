@@ -1,11 +1,14 @@
 #pragma once
 #include <span>
+#include <cstdint>
+#include "cache_sim.hpp"
 
-struct MatrixView
+template<class T>
+struct BasicMatrixView
 {
 private:
     int row_size;
-    std::span<int> data;
+    std::span<T> data;
 
     int row_start;
     int row_end;
@@ -13,25 +16,68 @@ private:
     int col_end;
     
 public:
-    MatrixView() = default;
-    MatrixView(std::span<int> data, int row_size, int row_start, int row_end, int col_start, int col_end)
+    BasicMatrixView() = default;
+    BasicMatrixView(std::span<T> data, int row_size, int row_start, int row_end, int col_start, int col_end)
         : data(data), row_size(row_size), row_start(row_start), row_end(row_end), col_start(col_start), col_end(col_end)
     {
     }
 
-    MatrixView(std::span<int> data, int row_size): 
-        MatrixView(data, row_size, 0, row_size ? data.size() / row_size : 0, 0, row_size)
+    BasicMatrixView(std::span<T> data, int row_size): 
+        BasicMatrixView(data, row_size, 0, row_size ? data.size() / row_size : 0, 0, row_size)
+    {
+    }
+
+#ifdef MATMUL_CACHE_SIM
+    // An element that tells the cache simulator about a read when its value is taken and a write when it is
+    // assigned, so reading through a view that could write isn't counted as a write
+    class ElementReference
+    {
+        T& element;
+
+    public:
+        explicit ElementReference(T& element) : element(element) {}
+
+        operator T() const
+        {
+            cachesim::access(&element, sizeof(T), false);
+            return element;
+        }
+        ElementReference& operator=(T value)
+        {
+            cachesim::access(&element, sizeof(T), true);
+            element = value;
+            return *this;
+        }
+        ElementReference& operator=(const ElementReference& other) { return *this = T(other); }
+        ElementReference& operator+=(T value) { return *this = T(*this) + value; }
+        ElementReference& operator-=(T value) { return *this = T(*this) - value; }
+    };
+    using Reference = ElementReference;
+#else
+    using Reference = T&;
+#endif
+
+    Reference operator()(int row, int col)
+    {
+        return Reference(data[row_size * (row_start + row) + col_start + col]);
+    }
+
+    T operator()(int row, int col) const 
     {
+        const T& element = data[row_size * (row_start + row) + col_start + col];
+        cachesim::access(&element, sizeof(T), false);
+        return element;
     }
 
-    int& operator()(int row, int col)
+    // Address of an element for the kernels that walk rows through pointers, which record their own accesses
+    T* pointer(int row, int col)
     {
-        return data[row_size * (row_start + row) + col_start + col];
+        return data.data() + std::size_t(row_size) * (row_start + row) + col_start + col;
     }
 
-    int operator()(int row, int col) const 
+    const T* pointer(int row, int col) const
     {
-        return data[row_size * (row_start + row) + col_start + col];
+        return data.data() + std::size_t(row_size) * (row_start + row) + col_start + col;
     }
 
     int row_count() const
@@ -44,9 +90,15 @@ public:
         return col_end - col_start;
     }
 
-    MatrixView getSubMatrix(int row_start, int row_end, int col_start, int col_end)
+    // Where the view lies in its buffer, to recognize it as a part of a larger matrix
+    const T* buffer() const { return data.data(); }
+    int buffer_row_size() const { return row_size; }
+    int first_row() const { return row_start; }
+    int first_col() const { return col_start; }
+
+    BasicMatrixView getSubMatrix(int row_start, int row_end, int col_start, int col_end)
     {
-        return MatrixView(data, row_size, 
+        return BasicMatrixView(data, row_size, 
             this->row_start + row_start, 
             this->row_start + row_end, 
             this->col_start + col_start, 
@@ -60,7 +112,7 @@ public:
                 (*this)(i, j) = 0;
     }
 
-    MatrixView& clone_from(MatrixView O)
+    BasicMatrixView& clone_from(BasicMatrixView O)
     {
         for (int i = 0; i < row_count() && i < O.row_count(); i++)
             for (int j = 0; j < col_count() && i < O.col_count(); j++)
@@ -69,7 +121,7 @@ public:
         return *this;
     }
 
-    MatrixView& add_eq(MatrixView O)
+    BasicMatrixView& add_eq(BasicMatrixView O)
     {
         for (int i = 0; i < row_count() && i < O.row_count(); i++)
             for (int j = 0; j < col_count() && i < O.col_count(); j++)
@@ -78,7 +130,7 @@ public:
         return *this;
     }
 
-    MatrixView& rem_eq(MatrixView O)
+    BasicMatrixView& rem_eq(BasicMatrixView O)
     {
         for (int i = 0; i < row_count() && i < O.row_count(); i++)
             for (int j = 0; j < col_count() && i < O.col_count(); j++)
@@ -87,7 +139,7 @@ public:
         return *this;
     }
 
-    bool is_equal(const MatrixView& other) const
+    bool is_equal(const BasicMatrixView& other) const
     {
         if (row_count() != other.row_count() || col_count() != other.col_count())
             return false;
@@ -98,7 +150,7 @@ public:
         return true;
     }
 
-    bool is_same_view(const MatrixView& other) const
+    bool is_same_view(const BasicMatrixView& other) const
     {
         return row_size == other.row_size &&
                data.data() == other.data.data() &&
@@ -108,15 +160,18 @@ public:
                col_end == other.col_end;
     }
 
-    friend class std::hash<MatrixView>;
+    friend class std::hash<BasicMatrixView>;
 };
 
+using MatrixView = BasicMatrixView<int>;
+using WideMatrixView = BasicMatrixView<std::int64_t>;
+
 namespace std
 {
-    template<>
-    struct hash<MatrixView>
+    template<class T>
+    struct hash<BasicMatrixView<T>>
     {
-        std::size_t operator()(const MatrixView& mv) const
+        std::size_t operator()(const BasicMatrixView<T>& mv) const
         {
             std::size_t h = 0;
 
@@ -176,6 +231,31 @@ void sub(MatrixView A, MatrixView B, MatrixView C) // C = A - B
                 C(i, j) = A(i, j) - B(i, j);
 }
 
+// count matrices of the same shape laid out in one buffer, the i-th one starting at data[i * stride]
+struct StridedMatrixBatch
+{
+    std::span<int> data;
+    int count;
+    int rows;
+    int cols;
+    std::size_t stride;
+
+    StridedMatrixBatch(std::span<int> data, int count, int rows, int cols)
+        : StridedMatrixBatch(data, count, rows, cols, std::size_t(rows) * cols)
+    {
+    }
+
+    StridedMatrixBatch(std::span<int> data, int count, int rows, int cols, std::size_t stride)
+        : data(data), count(count), rows(rows), cols(cols), stride(stride)
+    {
+    }
+
+    MatrixView operator[](int i) const
+    {
+        return MatrixView(data.subspan(i * stride, std::size_t(rows) * cols), cols);
+    }
+};
+
 enum class MatMulMode
 {
     Overwrite, // C  = A * B
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "MatrixView.hpp"
+#include "getL1CacheSize.hpp"
+
+// Copy of a matrix stored block by block: every block_size x block_size block is contiguous, with its own
+// row size, and the blocks of a block row follow each other. Multiplying by it then walks each block of
+// B linearly instead of jumping over whole rows of the original matrix.
+class PackedMatrix
+{
+    std::vector<int> storage;
+    std::span<int> data;
+    int rows;
+    int cols;
+    int block;
+
+public:
+    PackedMatrix(MatrixView B, int block_size = default_block_size())
+        : storage(std::size_t(B.row_count()) * B.col_count()), data(storage), rows(B.row_count()), cols(B.col_count()), block(std::max(block_size, 1))
+    {
+        for (int k = 0; k < rows; k += block)
+            for (int j = 0; j < cols; j += block)
+            {
+                MatrixView packed = block_at(k, j);
+                for (int i1 = 0; i1 < packed.row_count(); i1++)
+                    for (int j1 = 0; j1 < packed.col_count(); j1++)
+                        packed(i1, j1) = B(k + i1, j + j1);
+            }
+    }
+
+    PackedMatrix(const PackedMatrix&) = delete;
+    PackedMatrix& operator=(const PackedMatrix&) = delete;
+    PackedMatrix(PackedMatrix&&) = default;
+    PackedMatrix& operator=(PackedMatrix&&) = default;
+
+    // A packed block of B takes half of L2, leaving the other half for the blocks of A and C streamed past it
+    static int default_block_size()
+    {
+        static int block_size = []
+        {
+            size_t cache_size = getCacheSize(2);
+            if (cache_size == 0) cache_size = getL1CacheSize() * 8;
+            return std::max(1, int(sqrt(cache_size / sizeof(int) / 2)));
+        }();
+        return block_size;
+    }
+
+    int row_count() const { return rows; }
+    int col_count() const { return cols; }
+    int block_size() const { return block; }
+
+    // The block starting at row k and column j of the original matrix, both must be multiples of block_size
+    MatrixView block_at(int k, int j) const
+    {
+        int height = std::min(block, rows - k);
+        int width  = std::min(block, cols - j);
+        return MatrixView(data.subspan(std::size_t(k) * cols + std::size_t(j) * height, std::size_t(height) * width), width);
+    }
+};
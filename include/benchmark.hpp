@@ -0,0 +1,106 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <string>
+#include <format>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+struct BenchmarkSettings
+{
+    int warmup_runs = 1;                                    // untimed calls before measuring, the first one is also verified
+    int min_samples = 5;                                    // samples taken before the confidence target is checked
+    int max_samples = 1000;
+    double relative_error = 0.02;                           // target half-width of the 95% confidence interval of the mean
+    std::chrono::duration<double> max_time{0.5};            // measuring stops after this much time even if the target isn't met
+    std::chrono::duration<double> min_sample_time{200e-6};  // fast calls are repeated inside one sample to stay above the clock resolution
+};
+
+// Per call times, in seconds
+struct TimingStats
+{
+    double median = 0;
+    double min = 0;
+    double mean = 0;
+    double stddev = 0;
+    int samples = 0;
+    long long calls_per_sample = 0;
+
+    // half-width of the 95% confidence interval of the mean, relative to the mean
+    double relative_error() const
+    {
+        return samples > 1 && mean > 0 ? 1.96 * stddev / std::sqrt(samples) / mean : 0;
+    }
+};
+
+TimingStats compute_stats(std::vector<double> times, long long calls_per_sample)
+{
+    TimingStats stats;
+    stats.samples = int(times.size());
+    stats.calls_per_sample = calls_per_sample;
+    if (times.empty())
+        return stats;
+
+    std::ranges::sort(times);
+    stats.min = times.front();
+    stats.median = times.size() % 2 ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+    stats.mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+    if (times.size() > 1)
+    {
+        double sq = 0;
+        for (double t : times) sq += (t - stats.mean) * (t - stats.mean);
+        stats.stddev = std::sqrt(sq / (times.size() - 1));
+    }
+    return stats;
+}
+
+// Times call() after the warm-up runs are done by the caller. first_call is the duration of the last warm-up
+// run, used to pick how many calls one sample needs. Samples are taken until the confidence target is met
+// or the time budget is spent. For calls that change their own inputs, before_sample() runs before every
+// sample outside the timing (to restore them) and a sample makes at most max_calls_per_sample calls.
+template<class F, class S>
+TimingStats measure(F&& call, std::chrono::duration<double> first_call, const BenchmarkSettings& settings, S&& before_sample, long long max_calls_per_sample)
+{
+    using clock = std::chrono::steady_clock;
+
+    long long calls_per_sample = 1;
+    if (first_call < settings.min_sample_time)
+        calls_per_sample = (long long)std::ceil(settings.min_sample_time / std::max(first_call, std::chrono::duration<double>(1e-9)));
+    calls_per_sample = std::clamp(calls_per_sample, 1LL, std::max(max_calls_per_sample, 1LL));
+
+    std::vector<double> times;
+    auto started = clock::now();
+    while (int(times.size()) < settings.max_samples)
+    {
+        before_sample();
+        auto start = clock::now();
+        for (long long i = 0; i < calls_per_sample; i++)
+            call();
+        auto end = clock::now();
+        times.push_back(std::chrono::duration<double>(end - start).count() / calls_per_sample);
+
+        if (end - started >= settings.max_time)
+            break;
+        if (int(times.size()) >= settings.min_samples && compute_stats(times, calls_per_sample).relative_error() <= settings.relative_error)
+            break;
+    }
+
+    return compute_stats(std::move(times), calls_per_sample);
+}
+
+template<class F>
+TimingStats measure(F&& call, std::chrono::duration<double> first_call, const BenchmarkSettings& settings)
+{
+    return measure(call, first_call, settings, []{}, std::numeric_limits<long long>::max());
+}
+
+// Formats seconds with 3 significant digits in the closest unit
+std::string format_duration(double seconds)
+{
+    if (seconds < 1e-6) return std::format("{:.3g} ns", seconds * 1e9);
+    if (seconds < 1e-3) return std::format("{:.3g} us", seconds * 1e6);
+    if (seconds < 1)    return std::format("{:.3g} ms", seconds * 1e3);
+    return std::format("{:.3g} s", seconds);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "MatrixView.hpp"
+
+#ifdef MATMUL_HAS_CBLAS
+    #include <cblas.h>
+#endif
+
+// External baseline: dgemm of an installed CBLAS (OpenBLAS, BLIS, MKL...), compiled in with MATMUL_HAS_CBLAS,
+// which CMake defines when it finds one. BLAS has no integer gemm, so A and B are converted to doubles and the
+// result back to int, with the same wrapping as int arithmetic. That is exact while the products stay below
+// 2^53, far above what the benchmark's inputs produce. The O(n^2) conversions are part of the measured time.
+#ifdef MATMUL_HAS_CBLAS
+inline constexpr bool hasCblas = true;
+
+void cblasMatMul(MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+{
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+    if (n == 0 || p == 0)
+        return;
+    if (m == 0)
+    {
+        if (mode == MatMulMode::Overwrite)
+            C.clear();
+        return;
+    }
+
+    static thread_local std::vector<double> a, b, c;
+    a.resize(std::size_t(n) * m);
+    b.resize(std::size_t(m) * p);
+    c.resize(std::size_t(n) * p);
+
+    for (int i = 0; i < n; i++)
+    {
+        const int* row = A.pointer(i, 0);
+        for (int k = 0; k < m; k++)
+            a[std::size_t(i) * m + k] = row[k];
+    }
+    for (int k = 0; k < m; k++)
+    {
+        const int* row = B.pointer(k, 0);
+        for (int j = 0; j < p; j++)
+            b[std::size_t(k) * p + j] = row[j];
+    }
+
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, n, p, m, 1.0, a.data(), m, b.data(), p, 0.0, c.data(), p);
+
+    for (int i = 0; i < n; i++)
+    {
+        int* row = C.pointer(i, 0);
+        for (int j = 0; j < p; j++)
+        {
+            auto value = std::uint32_t(std::int64_t(c[std::size_t(i) * p + j]));
+            row[j] = int(mode == MatMulMode::Overwrite ? value : std::uint32_t(row[j]) + value);
+        }
+    }
+}
+#else
+inline constexpr bool hasCblas = false;
+#endif
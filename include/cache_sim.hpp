@@ -0,0 +1,259 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <span>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef MATMUL_CACHE_SIM
+    #include <mutex>
+    #include <atomic>
+    #include <memory>
+    #include <algorithm>
+    #include "getL1CacheSize.hpp"
+#endif
+
+// Data movement analysis, compiled in with MATMUL_CACHE_SIM (the CMake option of the same name). While it
+// records, every element read or assignment through a BasicMatrixView (and every row walked by the pointer
+// based kernels) goes through a multi-level LRU cache simulator configured like the detected caches, which
+// counts the lines each level reads from and writes back to the level below it, separately for A, B, C and
+// any other memory (scratch). Without MATMUL_CACHE_SIM all of it is empty inline functions.
+namespace cachesim
+{
+    enum class Operand { A, B, C, Scratch };
+
+    struct Traffic
+    {
+        std::array<std::uint64_t, 4> reads{};  // bytes, by Operand
+        std::array<std::uint64_t, 4> writes{};
+    };
+
+    struct LevelReport
+    {
+        int level;
+        std::size_t size;
+        std::size_t line_size;
+        Traffic traffic;       // between this level and the next one (or memory)
+    };
+
+    struct Report
+    {
+        std::array<std::uint64_t, 4> accesses{}; // bytes accessed by the multiplication itself, reads and writes
+        std::vector<LevelReport> levels;
+
+        bool empty() const { return levels.empty(); }
+    };
+
+#ifdef MATMUL_CACHE_SIM
+    inline constexpr bool enabled = true;
+
+    // One set-associative LRU cache level, lines are address / line_size
+    class Level
+    {
+        std::size_t sets;
+        std::size_t ways;
+        std::vector<std::uint64_t> lines; // every set's ways, most recently used first
+        std::vector<char> dirty;
+
+    public:
+        static constexpr std::uint64_t no_line = ~std::uint64_t(0);
+
+        CacheLevelInfo info;
+
+        explicit Level(CacheLevelInfo level) : info(level)
+        {
+            info.line_size = std::max<std::size_t>(info.line_size, 1);
+            ways = std::max<std::size_t>(info.ways, 1);
+            sets = std::max<std::size_t>(info.size / info.line_size / ways, 1);
+            lines.assign(sets * ways, no_line);
+            dirty.assign(sets * ways, 0);
+        }
+
+        // Makes line the most recently used one of its set and returns whether it was already there. The
+        // line evicted to make room is returned in evicted if it was dirty, otherwise evicted is no_line.
+        bool access(std::uint64_t line, bool write, std::uint64_t& evicted)
+        {
+            evicted = no_line;
+            std::size_t base = (line % sets) * ways;
+            std::size_t way = 0;
+            while (way < ways && lines[base + way] != line) way++;
+
+            bool hit = way < ways;
+            if (!hit)
+            {
+                way = ways - 1;
+                if (lines[base + way] != no_line && dirty[base + way])
+                    evicted = lines[base + way];
+                dirty[base + way] = 0;
+            }
+
+            char is_dirty = dirty[base + way] || write;
+            for (; way > 0; way--)
+            {
+                lines[base + way] = lines[base + way - 1];
+                dirty[base + way] = dirty[base + way - 1];
+            }
+            lines[base] = line;
+            dirty[base] = is_dirty;
+            return hit;
+        }
+
+        std::vector<std::uint64_t> take_dirty_lines()
+        {
+            std::vector<std::uint64_t> result;
+            for (std::size_t i = 0; i < lines.size(); i++)
+                if (lines[i] != no_line && dirty[i])
+                {
+                    result.push_back(lines[i]);
+                    dirty[i] = 0;
+                }
+            return result;
+        }
+    };
+
+    class Simulator
+    {
+        std::vector<Level> levels;
+        std::array<std::span<const std::byte>, 3> operands; // A, B, C
+        Report report;
+
+        // Operand overlapping [address, address + bytes), lines at the edges of an operand belong to it
+        Operand classify(std::uintptr_t address, std::size_t bytes = 1) const
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                auto begin = reinterpret_cast<std::uintptr_t>(operands[i].data());
+                if (address + bytes > begin && address < begin + operands[i].size())
+                    return Operand(i);
+            }
+            return Operand::Scratch;
+        }
+
+        // A miss reads the line from the next level, a dirty eviction writes the evicted line back to it.
+        // Write-backs that miss allocate the line without reading it, since the whole line is written.
+        void access_line(std::size_t level, std::uintptr_t address, bool write, bool fetch)
+        {
+            if (level == levels.size())
+                return;
+
+            Level& cache = levels[level];
+            Traffic& traffic = report.levels[level].traffic;
+            std::uint64_t evicted;
+            bool hit = cache.access(address / cache.info.line_size, write, evicted);
+
+            if (evicted != Level::no_line)
+            {
+                std::uintptr_t evicted_address = std::uintptr_t(evicted * cache.info.line_size);
+                traffic.writes[int(classify(evicted_address, cache.info.line_size))] += cache.info.line_size;
+                access_line(level + 1, evicted_address, true, false);
+            }
+            if (!hit && fetch)
+            {
+                traffic.reads[int(classify(address, cache.info.line_size))] += cache.info.line_size;
+                access_line(level + 1, address, false, true);
+            }
+        }
+
+    public:
+        Simulator(std::vector<CacheLevelInfo> hierarchy, std::span<const std::byte> A, std::span<const std::byte> B, std::span<const std::byte> C)
+            : operands{A, B, C}
+        {
+            for (const auto& info : hierarchy)
+            {
+                levels.emplace_back(info);
+                report.levels.push_back({info.level, info.size, levels.back().info.line_size, {}});
+            }
+        }
+
+        void access(const void* pointer, std::size_t bytes, bool write)
+        {
+            if (levels.empty() || bytes == 0)
+                return;
+
+            auto address = reinterpret_cast<std::uintptr_t>(pointer);
+            Operand operand = classify(address);
+            report.accesses[int(operand)] += bytes;
+
+            std::size_t line_size = levels.front().info.line_size;
+            for (std::uintptr_t line = address / line_size; line <= (address + bytes - 1) / line_size; line++)
+                access_line(0, line * line_size, write, true);
+        }
+
+        // Writes every dirty line back, level by level, and returns the counts
+        Report finish()
+        {
+            for (std::size_t level = 0; level < levels.size(); level++)
+                for (std::uint64_t line : levels[level].take_dirty_lines())
+                {
+                    std::uintptr_t address = std::uintptr_t(line * levels[level].info.line_size);
+                    report.levels[level].traffic.writes[int(classify(address, levels[level].info.line_size))] += levels[level].info.line_size;
+                    access_line(level + 1, address, true, false);
+                }
+            return report;
+        }
+    };
+
+    namespace detail
+    {
+        struct State
+        {
+            std::mutex mutex;
+            std::atomic<bool> recording = false;
+            std::unique_ptr<Simulator> simulator;
+        };
+
+        inline State& state()
+        {
+            static State s;
+            return s;
+        }
+    }
+
+    // Detected data caches, or a typical 32K L1 and 1M L2 if the platform doesn't tell
+    inline std::vector<CacheLevelInfo> default_hierarchy()
+    {
+        auto hierarchy = getCacheHierarchy();
+        if (hierarchy.empty())
+            hierarchy = {{1, 32 * 1024, 64, 8}, {2, 1024 * 1024, 64, 16}};
+        return hierarchy;
+    }
+
+    inline void access(const void* pointer, std::size_t bytes, bool write)
+    {
+        auto& state = detail::state();
+        if (!state.recording.load(std::memory_order_relaxed))
+            return;
+
+        std::lock_guard lock(state.mutex);
+        if (state.simulator)
+            state.simulator->access(pointer, bytes, write);
+    }
+
+    // Starts recording into empty caches, A, B and C are the memory of the operands
+    inline void start(std::span<const std::byte> A, std::span<const std::byte> B, std::span<const std::byte> C, std::vector<CacheLevelInfo> hierarchy = default_hierarchy())
+    {
+        auto& state = detail::state();
+        std::lock_guard lock(state.mutex);
+        state.simulator = std::make_unique<Simulator>(std::move(hierarchy), A, B, C);
+        state.recording = true;
+    }
+
+    inline Report stop()
+    {
+        auto& state = detail::state();
+        std::lock_guard lock(state.mutex);
+        state.recording = false;
+        if (!state.simulator)
+            return {};
+        Report report = state.simulator->finish();
+        state.simulator.reset();
+        return report;
+    }
+#else
+    inline constexpr bool enabled = false;
+
+    inline void access(const void*, std::size_t, bool) {}
+    inline void start(std::span<const std::byte>, std::span<const std::byte>, std::span<const std::byte>) {}
+    inline Report stop() { return {}; }
+#endif
+}
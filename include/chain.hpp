@@ -0,0 +1,270 @@
+#pragma once
+#include <span>
+#include <array>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include "MatrixView.hpp"
+#include "benchmark.hpp"
+#include "random_matrix.hpp"
+
+// Estimated cost (any unit, only compared) of one n x m times m x p multiplication
+struct ChainCostModel
+{
+    std::function<double(int, int, int)> cost;
+
+    double operator()(int n, int m, int p) const { return cost(n, m, p); }
+
+    // The textbook model: multiply-adds
+    static ChainCostModel flops()
+    {
+        return {[](int n, int m, int p) { return double(n) * m * p; }};
+    }
+
+    // Seconds, from timing multiplier on every shape with dimensions of calibration_sizes. Other shapes take the
+    // time per multiply-add interpolated between the measured ones (in log2 of the dimensions, the closest
+    // measured ones beyond them), so shapes that the multiplier handles with faster or slower strategies (matrix-
+    // vector kernels, small shapes dominated by the call overhead, large ones by memory traffic) are weighted
+    // by how fast it actually multiplies them.
+    template<class F>
+    static ChainCostModel calibrated(F multiplier, std::vector<int> calibration_sizes = {1, 8, 64, 256})
+    {
+        std::ranges::sort(calibration_sizes);
+        auto sizes = std::make_shared<std::vector<double>>(); // log2
+        for (int size : calibration_sizes) sizes->push_back(std::log2(std::max(size, 1)));
+        std::size_t count = calibration_sizes.size();
+        auto log_time = std::make_shared<std::vector<double>>(count * count * count); // log2 of seconds per multiply-add
+
+        BenchmarkSettings settings;
+        settings.min_samples = 3;
+        settings.max_samples = 20;
+        settings.max_time = std::chrono::duration<double>(0.01);
+        std::vector<int> A, B, C;
+        for (std::size_t i = 0; i < count; i++)
+            for (std::size_t j = 0; j < count; j++)
+                for (std::size_t k = 0; k < count; k++)
+                {
+                    int n = calibration_sizes[i], m = calibration_sizes[j], p = calibration_sizes[k];
+                    A.resize(std::size_t(n) * m);
+                    B.resize(std::size_t(m) * p);
+                    C.resize(std::size_t(n) * p);
+                    randomFill(A, 1, 0, 0, 100, 1);
+                    randomFill(B, 1, 1, 0, 100, 1);
+                    auto call = [&] { multiplier(MatrixView(A, m), MatrixView(B, p), MatrixView(C, p), MatMulMode::Overwrite); };
+
+                    auto start = std::chrono::steady_clock::now();
+                    call();
+                    TimingStats stats = measure(call, std::chrono::steady_clock::now() - start, settings);
+                    (*log_time)[(i * count + j) * count + k] = std::log2(std::max(stats.min, 1e-12) / (double(n) * m * p));
+                }
+
+        return {[sizes, log_time, count](int n, int m, int p)
+        {
+            // Trilinear interpolation between the closest measured sizes of every dimension
+            std::array<std::size_t, 3> low{};
+            std::array<double, 3> weight{};
+            std::array<int, 3> dims{n, m, p};
+            for (int d = 0; d < 3; d++)
+            {
+                double x = std::log2(std::max(dims[d], 1));
+                auto upper = std::ranges::upper_bound(*sizes, x);
+                if (upper == sizes->begin())     { low[d] = 0; weight[d] = 0; }
+                else if (upper == sizes->end())  { low[d] = count - 1; weight[d] = 0; }
+                else
+                {
+                    low[d] = std::size_t(upper - sizes->begin()) - 1;
+                    weight[d] = (x - (*sizes)[low[d]]) / ((*sizes)[low[d] + 1] - (*sizes)[low[d]]);
+                }
+            }
+
+            double log_seconds = 0;
+            for (int corner = 0; corner < 8; corner++)
+            {
+                double w = 1;
+                std::array<std::size_t, 3> at{};
+                for (int d = 0; d < 3; d++)
+                {
+                    bool up = corner >> d & 1;
+                    w *= up ? weight[d] : 1 - weight[d];
+                    at[d] = std::min(low[d] + up, count - 1);
+                }
+                if (w > 0) log_seconds += w * (*log_time)[(at[0] * count + at[1]) * count + at[2]];
+            }
+            return std::exp2(log_seconds) * n * m * p;
+        }};
+    }
+};
+
+// Parenthesization of A_0 * A_1 * ... * A_(k-1), where A_i is dims[i] x dims[i + 1]
+struct ChainPlan
+{
+    std::vector<int> dims;
+    std::vector<int> split; // (i, j) is computed as (i..split) * (split+1..j), at i * k + j
+    double cost = 0;        // of the whole chain by the model it was made with
+
+    int count() const { return int(dims.size()) - 1; }
+    int split_of(int i, int j) const { return split[std::size_t(i) * count() + j]; }
+
+    // Cost of the plan by another model than the one it was made with
+    double estimate(const ChainCostModel& model, int i = 0, int j = -1) const
+    {
+        if (j < 0) j = count() - 1;
+        if (i >= j) return 0;
+        int k = split_of(i, j);
+        return estimate(model, i, k) + estimate(model, k + 1, j) + model(dims[i], dims[k + 1], dims[j + 1]);
+    }
+
+    // Like ((A0 A1) A2)
+    std::string to_string(int i = 0, int j = -1) const
+    {
+        if (j < 0) j = count() - 1;
+        if (count() <= 0) return "";
+        if (i == j) return "A" + std::to_string(i);
+        int k = split_of(i, j);
+        return "(" + to_string(i, k) + " " + to_string(k + 1, j) + ")";
+    }
+};
+
+// The cheapest parenthesization by model, by the classic O(k^3) dynamic program over every subchain
+inline ChainPlan matrixChainPlan(std::span<const int> dims, const ChainCostModel& model)
+{
+    ChainPlan plan;
+    plan.dims.assign(dims.begin(), dims.end());
+    int k = plan.count();
+    if (k <= 0)
+        return plan;
+
+    std::vector<double> cost(std::size_t(k) * k, 0);
+    plan.split.assign(std::size_t(k) * k, 0);
+    for (int length = 2; length <= k; length++)
+        for (int i = 0; i + length - 1 < k; i++)
+        {
+            int j = i + length - 1;
+            double best = std::numeric_limits<double>::infinity();
+            for (int s = i; s < j; s++)
+            {
+                double c = cost[std::size_t(i) * k + s] + cost[std::size_t(s + 1) * k + j] + model(dims[i], dims[s + 1], dims[j + 1]);
+                if (c < best)
+                {
+                    best = c;
+                    plan.split[std::size_t(i) * k + j] = s;
+                }
+            }
+            cost[std::size_t(i) * k + j] = best;
+        }
+    plan.cost = cost[k - 1];
+    return plan;
+}
+
+// Left to right, the order the chain is written in, for comparison
+inline ChainPlan leftToRightChainPlan(std::span<const int> dims, const ChainCostModel& model)
+{
+    ChainPlan plan;
+    plan.dims.assign(dims.begin(), dims.end());
+    int k = plan.count();
+    if (k <= 0)
+        return plan;
+
+    plan.split.assign(std::size_t(k) * k, 0);
+    for (int j = 1; j < k; j++)
+    {
+        plan.split[j] = j - 1;
+        plan.cost += model(dims[0], dims[j], dims[j + 1]);
+    }
+    return plan;
+}
+
+// Reuses the buffers of the intermediate products: a released buffer goes to the next product that fits into it
+class ChainBufferPool
+{
+    std::vector<std::vector<int>> free;
+
+public:
+    std::vector<int> acquire(std::size_t size)
+    {
+        auto best = free.end();
+        for (auto it = free.begin(); it != free.end(); it++)
+            if (it->capacity() >= size && (best == free.end() || it->capacity() < best->capacity()))
+                best = it;
+        if (best == free.end() && !free.empty())
+            best = std::ranges::max_element(free, {}, [](const auto& buffer) { return buffer.capacity(); });
+
+        std::vector<int> buffer;
+        if (best != free.end())
+        {
+            buffer = std::move(*best);
+            free.erase(best);
+        }
+        buffer.resize(size);
+        return buffer;
+    }
+
+    void release(std::vector<int>&& buffer) { free.push_back(std::move(buffer)); }
+};
+
+// C = A_0 * A_1 * ... (or C += ...) in the order of plan (see matrixChainPlan), made for the dimensions of
+// matrices. multiplier(A, B, C, mode) multiplies each pair; the intermediate products come from pool, so the
+// buffers of finished subchains are reused by the next ones (and by the next calls, given the same pool).
+// Nothing happens if the dimensions don't chain or don't match C or the plan.
+template<class F>
+void chainMatMul(std::span<const MatrixView> matrices, MatrixView C, MatMulMode mode, const ChainPlan& plan, F multiplier, ChainBufferPool& pool)
+{
+    int k = int(matrices.size());
+    if (k == 0 || plan.count() != k)
+        return;
+    for (int i = 0; i < k; i++)
+        if (matrices[i].row_count() != plan.dims[i] || matrices[i].col_count() != plan.dims[i + 1])
+            return;
+    if (C.row_count() != plan.dims[0] || C.col_count() != plan.dims[k])
+        return;
+
+    if (k == 1)
+    {
+        MatrixView A = matrices[0];
+        for (int i = 0; i < C.row_count(); i++)
+            for (int j = 0; j < C.col_count(); j++)
+                C(i, j) = mode == MatMulMode::Overwrite ? A(i, j) : int(std::uint32_t(C(i, j)) + std::uint32_t(A(i, j)));
+        return;
+    }
+
+    // Computes the subchain i..j (at least 2 matrices) into out
+    auto compute = [&](auto& self, int i, int j, MatrixView out, MatMulMode out_mode) -> void
+    {
+        int s = plan.split_of(i, j);
+        std::array<std::vector<int>, 2> buffers;
+        std::array<MatrixView, 2> operands;
+        for (int side = 0; side < 2; side++)
+        {
+            int first = side ? s + 1 : i, last = side ? j : s;
+            if (first == last)
+            {
+                operands[side] = matrices[first];
+                continue;
+            }
+            int rows = plan.dims[first], cols = plan.dims[last + 1];
+            buffers[side] = pool.acquire(std::size_t(rows) * cols);
+            operands[side] = MatrixView(buffers[side], cols, 0, rows, 0, cols);
+            self(self, first, last, operands[side], MatMulMode::Overwrite);
+        }
+        multiplier(operands[0], operands[1], out, out_mode);
+        for (auto& buffer : buffers)
+            if (buffer.capacity()) pool.release(std::move(buffer));
+    };
+    compute(compute, 0, k - 1, C, mode);
+}
+
+template<class F>
+void chainMatMul(std::span<const MatrixView> matrices, MatrixView C, MatMulMode mode, F multiplier, const ChainCostModel& model = ChainCostModel::flops())
+{
+    std::vector<int> dims;
+    for (const auto& matrix : matrices) dims.push_back(matrix.row_count());
+    if (!matrices.empty()) dims.push_back(matrices.back().col_count());
+    ChainBufferPool pool;
+    chainMatMul(matrices, C, mode, matrixChainPlan(dims, model), multiplier, pool);
+}
@@ -0,0 +1,342 @@
+#pragma once
+#include <span>
+#include <vector>
+#include <string>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "MatrixView.hpp"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+// What the distributed engine needs from the ranks it runs on. Every rank calls the collectives in the same
+// order and the same number of times, ranks of disjoint groups may run the same collective at the same time.
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    // data of root to every other rank of group, which all pass buffers of the same size
+    virtual void broadcast(std::span<int> data, int root, std::span<const int> group) = 0;
+    // Element-wise sum of data over group into data of root
+    virtual void reduce(std::span<int> data, int root, std::span<const int> group) = 0;
+
+    std::uint64_t bytes_sent = 0;
+};
+
+#ifndef _WIN32
+// Ranks that are local processes sharing one POSIX shared memory segment: a process-shared barrier and a
+// slot per rank, which a rank writes its data to for the others to read after the barrier.
+class ShmTransport : public Transport
+{
+    struct Segment
+    {
+        pthread_barrier_t barrier;
+        int size;
+        std::size_t slot_elements;
+    };
+
+    Segment* segment = nullptr;
+    std::size_t segment_bytes = 0;
+    int this_rank = 0;
+    pid_t owner = getpid(); // the process that created the segment, the forked ranks never clean it up
+
+    static std::size_t slots_offset() { return (sizeof(Segment) + 63) / 64 * 64; }
+
+    int* slot(int rank) const
+    {
+        return reinterpret_cast<int*>(reinterpret_cast<char*>(segment) + slots_offset()) + std::size_t(rank) * segment->slot_elements;
+    }
+
+    void barrier() { pthread_barrier_wait(&segment->barrier); }
+
+    ShmTransport(Segment* segment, std::size_t segment_bytes) : segment(segment), segment_bytes(segment_bytes) {}
+
+public:
+    ShmTransport(const ShmTransport&) = delete;
+    ShmTransport& operator=(const ShmTransport&) = delete;
+
+    ~ShmTransport()
+    {
+        if (getpid() == owner)
+            pthread_barrier_destroy(&segment->barrier);
+        munmap(segment, segment_bytes);
+    }
+
+    int rank() const override { return this_rank; }
+    int size() const override { return segment->size; }
+
+    void broadcast(std::span<int> data, int root, std::span<const int>) override
+    {
+        if (this_rank == root)
+        {
+            std::copy(data.begin(), data.end(), slot(root));
+            bytes_sent += data.size_bytes();
+        }
+        barrier();
+        if (this_rank != root)
+            std::copy(slot(root), slot(root) + data.size(), data.begin());
+        barrier();
+    }
+
+    void reduce(std::span<int> data, int root, std::span<const int> group) override
+    {
+        if (this_rank != root)
+        {
+            std::copy(data.begin(), data.end(), slot(this_rank));
+            bytes_sent += data.size_bytes();
+        }
+        barrier();
+        if (this_rank == root)
+            for (int member : group)
+                if (member != root)
+                    for (std::size_t i = 0; i < data.size(); i++)
+                        data[i] = int(std::uint32_t(data[i]) + std::uint32_t(slot(member)[i]));
+        barrier();
+    }
+
+    // A segment for size ranks that exchange at most slot_elements ints at a time. The segment is unlinked
+    // right away, the processes forked afterwards share it through the mapping.
+    static std::unique_ptr<ShmTransport> create(int size, std::size_t slot_elements)
+    {
+        std::string name = "/matmul-" + std::to_string(getpid());
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+            return nullptr;
+        shm_unlink(name.c_str());
+
+        std::size_t bytes = slots_offset() + std::size_t(size) * std::max<std::size_t>(slot_elements, 1) * sizeof(int);
+        void* mapping = ftruncate(fd, off_t(bytes)) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapping == MAP_FAILED)
+            return nullptr;
+
+        auto segment = static_cast<Segment*>(mapping);
+        segment->size = size;
+        segment->slot_elements = std::max<std::size_t>(slot_elements, 1);
+        pthread_barrierattr_t attributes;
+        pthread_barrierattr_init(&attributes);
+        pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        int error = pthread_barrier_init(&segment->barrier, &attributes, unsigned(size));
+        pthread_barrierattr_destroy(&attributes);
+        if (error)
+        {
+            munmap(mapping, bytes);
+            return nullptr;
+        }
+        return std::unique_ptr<ShmTransport>(new ShmTransport(segment, bytes));
+    }
+
+    // Forks one process per rank and runs body(*this) in each of them with rank set. Returns whether every
+    // rank returned true; if one fails or dies the others are killed, since they would wait for it forever.
+    template<class F>
+    bool run(F body)
+    {
+        std::vector<pid_t> children;
+        for (int rank = 0; rank < size(); rank++)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                this_rank = rank;
+                bool ok = body(*this);
+                _exit(ok ? 0 : 1);
+            }
+            if (pid < 0)
+                break;
+            children.push_back(pid);
+        }
+
+        bool ok = int(children.size()) == size();
+        if (!ok)
+            for (pid_t child : children) kill(child, SIGKILL);
+
+        for (std::size_t remaining = children.size(); remaining > 0; remaining--)
+        {
+            int status = 0;
+            if (waitpid(-1, &status, 0) < 0)
+                return false;
+            if (ok && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+            {
+                ok = false;
+                for (pid_t child : children) kill(child, SIGKILL);
+            }
+        }
+        return ok;
+    }
+};
+#endif
+
+namespace detail
+{
+    // First index of part `part` of count split into parts nearly equal parts
+    inline int split_point(int count, int parts, int part)
+    {
+        return int(std::int64_t(count) * part / parts);
+    }
+}
+
+// One rank of C = A * B on a grid x grid x layers process grid, rank = (layer * grid + row) * grid + col.
+// Block (row, col) of A, B and C (split nearly evenly, grid blocks per dimension) belongs to the ranks at
+// (row, col) of every layer. With one layer this is SUMMA: in step k the owners of column k of A and row k
+// of B broadcast their blocks along the rows and columns of the grid, and every rank adds their product to
+// its C block. With more layers (the 2.5D algorithm) the blocks are first replicated to every layer, each
+// layer does grid / layers of the steps, and the layers' C blocks are summed into layer 0. A rank only reads
+// its own blocks of A and B and only layer 0 writes its block of C (C = A * B, mode of the caller aside).
+template<class F>
+bool summaRank(Transport& transport, int grid, int layers, MatrixView A, MatrixView B, MatrixView C, F multiplier)
+{
+    int rank = transport.rank();
+    int layer = rank / (grid * grid), row = rank / grid % grid, col = rank % grid;
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+
+    auto block = [&](MatrixView X, int rows, int cols, int r, int c)
+    {
+        return X.getSubMatrix(detail::split_point(rows, grid, r), detail::split_point(rows, grid, r + 1),
+                              detail::split_point(cols, grid, c), detail::split_point(cols, grid, c + 1));
+    };
+    auto copy = [](MatrixView from, std::vector<int>& to)
+    {
+        to.resize(std::size_t(from.row_count()) * from.col_count());
+        for (int i = 0; i < from.row_count(); i++)
+            for (int j = 0; j < from.col_count(); j++)
+                to[std::size_t(i) * from.col_count() + j] = from(i, j);
+    };
+    auto ranks = [&](auto rank_of)
+    {
+        std::vector<int> group;
+        for (int i = 0; i < grid; i++)
+            group.push_back(rank_of(i));
+        return group;
+    };
+
+    std::vector<int> row_group = ranks([&](int c) { return (layer * grid + row) * grid + c; });
+    std::vector<int> col_group = ranks([&](int r) { return (layer * grid + r) * grid + col; });
+    std::vector<int> fiber;
+    for (int l = 0; l < layers; l++)
+        fiber.push_back((l * grid + row) * grid + col);
+
+    // The blocks start out on layer 0
+    std::vector<int> own_A, own_B;
+    MatrixView own_A_view = block(A, n, m, row, col), own_B_view = block(B, m, p, row, col);
+    if (layer == 0)
+    {
+        copy(own_A_view, own_A);
+        copy(own_B_view, own_B);
+    }
+    own_A.resize(std::size_t(own_A_view.row_count()) * own_A_view.col_count());
+    own_B.resize(std::size_t(own_B_view.row_count()) * own_B_view.col_count());
+    if (layers > 1)
+    {
+        transport.broadcast(own_A, fiber.front(), fiber);
+        transport.broadcast(own_B, fiber.front(), fiber);
+    }
+
+    int rows = detail::split_point(n, grid, row + 1) - detail::split_point(n, grid, row);
+    int cols = detail::split_point(p, grid, col + 1) - detail::split_point(p, grid, col);
+    std::vector<int> local_C(std::size_t(rows) * cols, 0);
+    std::vector<int> panel_A, panel_B;
+
+    // Layers with fewer steps than others still take part in every round of collectives, with nothing to send
+    int first = detail::split_point(grid, layers, layer), last = detail::split_point(grid, layers, layer + 1);
+    for (int round = 0; round < (grid + layers - 1) / layers; round++)
+    {
+        int k = first + round;
+        if (k >= last)
+        {
+            transport.broadcast({}, rank, std::span<const int>(&rank, 1));
+            transport.broadcast({}, rank, std::span<const int>(&rank, 1));
+            continue;
+        }
+        int depth = detail::split_point(m, grid, k + 1) - detail::split_point(m, grid, k);
+        if (col == k) panel_A = own_A;
+        else          panel_A.resize(std::size_t(rows) * depth);
+        if (row == k) panel_B = own_B;
+        else          panel_B.resize(std::size_t(depth) * cols);
+
+        transport.broadcast(panel_A, row_group[k], row_group);
+        transport.broadcast(panel_B, col_group[k], col_group);
+
+        if (rows > 0 && cols > 0 && depth > 0)
+            multiplier(MatrixView(panel_A, depth), MatrixView(panel_B, cols), MatrixView(local_C, cols), MatMulMode::Add);
+    }
+
+    if (layers > 1)
+        transport.reduce(local_C, fiber.front(), fiber);
+
+    if (layer == 0)
+    {
+        MatrixView own_C = block(C, n, p, row, col);
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < cols; j++)
+                own_C(i, j) = local_C[std::size_t(i) * cols + j];
+    }
+    return true;
+}
+
+struct DistributedStats
+{
+    bool ok = false;
+    std::uint64_t bytes_sent = 0; // by all ranks together
+};
+
+// C = A * B (or C += A * B) on grid * grid * layers local processes over ShmTransport, every rank running
+// multiplier on its blocks (see summaRank). layers is at most grid; 1 is SUMMA, more is 2.5D.
+template<class F>
+DistributedStats distributedMatMul(MatrixView A, MatrixView B, MatrixView C, MatMulMode mode, int grid, int layers, F multiplier)
+{
+    DistributedStats stats;
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+    if (A.col_count() != B.row_count() || C.row_count() != n || C.col_count() != p || grid < 1 || layers < 1 || layers > grid)
+        return stats;
+
+#ifndef _WIN32
+    int size = grid * grid * layers;
+    auto blocks = [&](int rows, int cols) { return std::size_t((rows + grid - 1) / grid) * ((cols + grid - 1) / grid); };
+    auto transport = ShmTransport::create(size, std::max({blocks(n, m), blocks(m, p), blocks(n, p)}));
+    if (!transport)
+        return stats;
+
+    // The bytes every rank sent and the product, shared with the ranks
+    std::size_t result_bytes = size * sizeof(std::uint64_t) + std::size_t(n) * p * sizeof(int);
+    void* mapping = mmap(nullptr, result_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        return stats;
+    auto sent = static_cast<std::uint64_t*>(mapping);
+    std::span<int> result(reinterpret_cast<int*>(sent + size), std::size_t(n) * p);
+
+    stats.ok = transport->run([&](Transport& rank)
+    {
+        bool ok = summaRank(rank, grid, layers, A, B, MatrixView(result, p, 0, n, 0, p), multiplier);
+        sent[rank.rank()] = rank.bytes_sent;
+        return ok;
+    });
+
+    if (stats.ok)
+    {
+        for (int i = 0; i < size; i++)
+            stats.bytes_sent += sent[i];
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < p; j++)
+            {
+                int value = result[std::size_t(i) * p + j];
+                if (mode == MatMulMode::Overwrite) C(i, j) = value;
+                else                               C(i, j) = int(std::uint32_t(C(i, j)) + std::uint32_t(value));
+            }
+    }
+    munmap(mapping, result_bytes);
+#endif
+    return stats;
+}
@@ -0,0 +1,227 @@
+#pragma once
+#include <array>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <future>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+#include <tuple>
+#include <cstdint>
+#include "MatrixMultiplier.hpp"
+
+// Multiplies submitted requests on a pool of worker threads, so callers can overlap independent products with
+// each other and with their own work. The multiplier and the views of a request must stay valid until it is
+// done. Requests are served shortest first on a virtual clock: a request of f multiply-adds submitted at
+// virtual time V is due at V + f, and the clock only advances, by their size, as requests are taken. Small
+// requests overtake queued big ones, but only until the ones taken after a big request was queued add up to
+// its size: new requests are then due after it and it gets its turn. Consecutive requests of up to batch_flops
+// together are taken as one batch and run with MatrixMultiplier::batched, which chooses the strategy once per
+// shape.
+class MatMulExecutor
+{
+    struct Request
+    {
+        std::uint64_t key;      // virtual time the request is due, its start time plus flops
+        std::uint64_t sequence; // submission order among equal keys
+        std::uint64_t flops;
+        const MatrixMultiplier* multiplier;
+        std::array<MatrixView, 3> views;
+        const PackedMatrix* packed; // B instead of views[1], if not null
+        MatMulMode mode;
+        std::function<void(std::exception_ptr)> done;
+
+        bool operator>(const Request& other) const
+        {
+            return key != other.key ? key > other.key : sequence > other.sequence;
+        }
+    };
+
+    std::priority_queue<Request, std::vector<Request>, std::greater<>> queue;
+    std::mutex mutex;
+    std::condition_variable wake; // workers: a request was queued or the executor stops
+    std::condition_variable idle; // wait_idle: nothing is queued or running anymore
+    std::uint64_t virtual_time = 0;
+    std::uint64_t sequence = 0;
+    std::size_t running = 0;
+    bool stopping = false;
+    std::uint64_t batch_flops;
+    std::size_t max_batch;
+    std::vector<std::thread> workers;
+
+    // Takes the next request and, while it stays small, the ones after it
+    std::vector<Request> next_batch()
+    {
+        std::vector<Request> batch;
+        std::uint64_t flops = 0;
+        do
+        {
+            virtual_time = std::max(virtual_time, queue.top().key - queue.top().flops) + queue.top().flops;
+            flops += queue.top().flops;
+            batch.push_back(queue.top());
+            queue.pop();
+        } while (!queue.empty() && batch.size() < max_batch && flops + queue.top().flops <= batch_flops);
+        return batch;
+    }
+
+    // Requests of one multiplier and mode run as one MatrixMultiplier::batched call, on this thread, the ones
+    // with a packed B one by one
+    static void run(std::vector<Request>& batch)
+    {
+        std::stable_sort(batch.begin(), batch.end(), [](const Request& a, const Request& b)
+        {
+            return std::tie(a.multiplier, a.mode) < std::tie(b.multiplier, b.mode);
+        });
+
+        std::vector<std::array<MatrixView, 3>> views;
+        for (std::size_t begin = 0, end; begin < batch.size(); begin = end)
+        {
+            views.clear();
+            for (end = begin; end < batch.size() && batch[end].multiplier == batch[begin].multiplier && batch[end].mode == batch[begin].mode; end++)
+            {
+                if (batch[end].packed && end > begin) break;
+                views.push_back(batch[end].views);
+                if (batch[end].packed) { end++; break; }
+            }
+
+            const Request& first = batch[begin];
+            std::exception_ptr error;
+            try
+            {
+                if (first.packed)           (*first.multiplier)(views[0][0], *first.packed, views[0][2], first.mode);
+                else if (views.size() == 1) (*first.multiplier)(views[0][0], views[0][1], views[0][2], first.mode);
+                else                        first.multiplier->batched(views, first.mode, 1);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            for (std::size_t i = begin; i < end; i++)
+                batch[i].done(error);
+        }
+    }
+
+    void push(const MatrixMultiplier& multiplier, std::array<MatrixView, 3> views, const PackedMatrix* packed, int p, MatMulMode mode, std::function<void(std::exception_ptr)> done)
+    {
+        std::uint64_t flops = std::uint64_t(views[0].row_count()) * views[0].col_count() * p;
+        {
+            std::lock_guard lock(mutex);
+            queue.push({virtual_time + flops, sequence++, flops, &multiplier, views, packed, mode, std::move(done)});
+        }
+        wake.notify_one();
+    }
+
+    void work()
+    {
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+
+            std::vector<Request> batch = next_batch();
+            running += batch.size();
+            lock.unlock();
+            run(batch);
+            lock.lock();
+            running -= batch.size();
+            if (queue.empty() && running == 0)
+                idle.notify_all();
+        }
+    }
+
+public:
+    // batch_flops: requests are batched while they add up to at most this many multiply-adds
+    explicit MatMulExecutor(int thread_count = std::thread::hardware_concurrency(), std::uint64_t batch_flops = 1 << 18, std::size_t max_batch = 64)
+        : batch_flops(batch_flops), max_batch(std::max<std::size_t>(max_batch, 1))
+    {
+        for (int i = 0; i < std::max(thread_count, 1); i++)
+            workers.emplace_back(&MatMulExecutor::work, this);
+    }
+
+    MatMulExecutor(const MatMulExecutor&) = delete;
+    MatMulExecutor& operator=(const MatMulExecutor&) = delete;
+
+    // Finishes every submitted request first
+    ~MatMulExecutor()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    // Queues C = A * B (or C += A * B) and calls done, on a worker thread, with the exception the
+    // multiplication threw or a null one once it is over. Requests with invalid dimensions leave C as it is.
+    void submit(const MatrixMultiplier& multiplier, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode, std::function<void(std::exception_ptr)> done)
+    {
+        push(multiplier, {A, B, C}, nullptr, B.col_count(), mode, std::move(done));
+    }
+
+    // The same with B packed once for many requests, which must stay valid until they are done as well
+    void submit(const MatrixMultiplier& multiplier, MatrixView A, const PackedMatrix& B, MatrixView C, MatMulMode mode, std::function<void(std::exception_ptr)> done)
+    {
+        push(multiplier, {A, MatrixView(), C}, &B, B.col_count(), mode, std::move(done));
+    }
+
+    std::future<void> submit(const MatrixMultiplier& multiplier, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        std::future<void> result = promise->get_future();
+        submit(multiplier, A, B, C, mode, [promise](std::exception_ptr error)
+        {
+            if (error) promise->set_exception(error);
+            else       promise->set_value();
+        });
+        return result;
+    }
+
+    // co_await executor.multiply(...) in a coroutine: suspends it until the product is done and resumes it on
+    // the worker thread that finished it (rethrowing what the multiplication threw)
+    auto multiply(const MatrixMultiplier& multiplier, MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+    {
+        struct Awaitable
+        {
+            MatMulExecutor& executor;
+            const MatrixMultiplier& multiplier;
+            std::array<MatrixView, 3> views;
+            MatMulMode mode;
+            std::exception_ptr error;
+
+            bool await_ready() const { return false; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                executor.submit(multiplier, views[0], views[1], views[2], mode, [this, handle](std::exception_ptr e)
+                {
+                    error = e;
+                    handle.resume();
+                });
+            }
+            void await_resume() const
+            {
+                if (error) std::rethrow_exception(error);
+            }
+        };
+        return Awaitable{*this, multiplier, {A, B, C}, mode, nullptr};
+    }
+
+    // Blocks until every request submitted so far is done
+    void wait_idle()
+    {
+        std::unique_lock lock(mutex);
+        idle.wait(lock, [this] { return queue.empty() && running == 0; });
+    }
+
+    std::size_t pending()
+    {
+        std::lock_guard lock(mutex);
+        return queue.size() + running;
+    }
+};
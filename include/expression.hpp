@@ -0,0 +1,169 @@
+#pragma once
+#include <vector>
+#include <concepts>
+#include <cstdint>
+#include <algorithm>
+#include "MatrixView.hpp"
+#include "PackedMatrix.hpp"
+
+// Lazy sums of products, like lazy(A) * lazy(B) + lazy(D) * lazy(E) - lazy(F). The operators only build the
+// expression; evaluate computes it into C in one pass over the tiles of C, without temporaries of C's size.
+namespace expr
+{
+    // One term of the flattened expression: sign * left, or sign * left * right for products
+    struct Term
+    {
+        MatrixView left, right;
+        bool product;
+        int sign;
+    };
+
+    struct Matrix
+    {
+        MatrixView view;
+
+        int row_count() const { return view.row_count(); }
+        int col_count() const { return view.col_count(); }
+        void collect(std::vector<Term>& terms, int sign) const { terms.push_back({view, {}, false, sign}); }
+    };
+
+    // Only of two matrices: a product of sums or of products would need a temporary
+    struct Product
+    {
+        MatrixView left, right;
+
+        int row_count() const { return left.row_count(); }
+        int col_count() const { return right.col_count(); }
+        void collect(std::vector<Term>& terms, int sign) const { terms.push_back({left, right, true, sign}); }
+    };
+
+    template<class L, class R>
+    struct Sum
+    {
+        L left;
+        R right;
+        int sign; // of right
+
+        int row_count() const { return left.row_count(); }
+        int col_count() const { return left.col_count(); }
+        void collect(std::vector<Term>& terms, int sign) const
+        {
+            left.collect(terms, sign);
+            right.collect(terms, sign * this->sign);
+        }
+    };
+
+    template<class E>
+    struct Negation
+    {
+        E expression;
+
+        int row_count() const { return expression.row_count(); }
+        int col_count() const { return expression.col_count(); }
+        void collect(std::vector<Term>& terms, int sign) const { expression.collect(terms, -sign); }
+    };
+
+    template<class E>
+    concept Expression = requires(const E& e, std::vector<Term>& terms)
+    {
+        e.collect(terms, 1);
+        { e.row_count() } -> std::convertible_to<int>;
+    };
+
+    inline Product operator*(Matrix left, Matrix right) { return {left.view, right.view}; }
+
+    template<Expression L, Expression R>
+    Sum<L, R> operator+(L left, R right) { return {left, right, 1}; }
+
+    template<Expression L, Expression R>
+    Sum<L, R> operator-(L left, R right) { return {left, right, -1}; }
+
+    template<Expression E>
+    Negation<E> operator-(E expression) { return {expression}; }
+}
+
+inline expr::Matrix lazy(MatrixView view) { return {view}; }
+
+// C = expression (or C += expression), tile by tile: the matrix terms of a tile are summed in one pass that
+// writes it, then the products accumulate into it (multiplier(A, B, C, mode) on the rows of A and columns of B
+// the tile needs) while it is still in cache. Products with a minus go through a tile-sized scratch. The
+// destination may itself be a matrix term (C = A * B + C), but it must not overlap the factors of a product.
+// Nothing happens if the shapes don't match.
+template<expr::Expression E, class F>
+void evaluate(const E& expression, MatrixView C, MatMulMode mode, F multiplier, int tile_size = PackedMatrix::default_block_size())
+{
+    std::vector<expr::Term> terms;
+    expression.collect(terms, 1);
+
+    int n = C.row_count(), p = C.col_count();
+    for (const auto& term : terms)
+    {
+        int rows = term.left.row_count(), cols = term.product ? term.right.col_count() : term.left.col_count();
+        if (rows != n || cols != p || (term.product && term.left.col_count() != term.right.row_count()))
+            return;
+    }
+
+    std::vector<expr::Term> matrices, products;
+    for (const auto& term : terms)
+        (term.product ? products : matrices).push_back(term);
+
+    tile_size = std::max(tile_size, 1);
+    std::vector<int> scratch;
+    if (std::ranges::any_of(products, [](const auto& term){ return term.sign < 0; }))
+        scratch.resize(std::size_t(std::min(tile_size, n)) * std::min(tile_size, p));
+
+    for (int i = 0; i < n; i += tile_size)
+        for (int j = 0; j < p; j += tile_size)
+        {
+            int rows = std::min(tile_size, n - i), cols = std::min(tile_size, p - j);
+            MatrixView tile = C.getSubMatrix(i, i + rows, j, j + cols);
+            bool written = mode == MatMulMode::Add; // whether the tile holds something to accumulate onto
+
+            if (!matrices.empty())
+            {
+                for (int r = 0; r < rows; r++)
+                {
+                    int* out = tile.pointer(r, 0);
+                    if (written) cachesim::access(out, cols * sizeof(int), false);
+                    cachesim::access(out, cols * sizeof(int), true);
+                    for (int c = 0; c < cols; c++)
+                    {
+                        std::uint32_t value = written ? std::uint32_t(out[c]) : 0;
+                        for (const auto& term : matrices)
+                            value += std::uint32_t(term.sign) * std::uint32_t(term.left(i + r, j + c));
+                        out[c] = int(value);
+                    }
+                }
+                written = true;
+            }
+
+            for (auto& term : products)
+            {
+                int m = term.left.col_count();
+                MatrixView A = term.left.getSubMatrix(i, i + rows, 0, m);
+                MatrixView B = term.right.getSubMatrix(0, m, j, j + cols);
+                if (term.sign > 0)
+                    multiplier(A, B, tile, written ? MatMulMode::Add : MatMulMode::Overwrite);
+                else
+                {
+                    if (!written) tile.clear();
+                    MatrixView product(std::span<int>(scratch).first(std::size_t(rows) * cols), cols);
+                    multiplier(A, B, product, MatMulMode::Overwrite);
+                    for (int r = 0; r < rows; r++)
+                    {
+                        int* out = tile.pointer(r, 0);
+                        const int* subtracted = product.pointer(r, 0);
+                        cachesim::access(out, cols * sizeof(int), false);
+                        cachesim::access(subtracted, cols * sizeof(int), false);
+                        cachesim::access(out, cols * sizeof(int), true);
+                        for (int c = 0; c < cols; c++)
+                            out[c] = int(std::uint32_t(out[c]) - std::uint32_t(subtracted[c]));
+                    }
+                }
+                written = true;
+            }
+
+            if (!written)
+                tile.clear();
+        }
+}
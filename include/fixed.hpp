@@ -0,0 +1,87 @@
+#pragma once
+#include "MatrixView.hpp"
+
+#include <array>
+#include <utility>
+
+// N x M x P multiplication with every trip count known at compile time, so the compiler unrolls the loops
+// completely and keeps each row of C in P accumulators (vector registers) instead of going through memory.
+template<int N, int M, int P>
+void fixedSizeMatMul(MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+{
+    const int* b[M];
+    for (int k = 0; k < M; k++)
+        b[k] = B.pointer(k, 0);
+
+    for (int i = 0; i < N; i++)
+    {
+        const int* a = A.pointer(i, 0);
+        int* c_row = C.pointer(i, 0);
+
+        int c[P]{};
+        if (mode == MatMulMode::Add)
+        {
+            cachesim::access(c_row, P * sizeof(int), false);
+            for (int j = 0; j < P; j++)
+                c[j] = c_row[j];
+        }
+
+        for (int k = 0; k < M; k++)
+        {
+            cachesim::access(&a[k], sizeof(int), false);
+            cachesim::access(b[k], P * sizeof(int), false);
+            for (int j = 0; j < P; j++)
+                c[j] += a[k] * b[k][j];
+        }
+
+        cachesim::access(c_row, P * sizeof(int), true);
+        for (int j = 0; j < P; j++)
+            c_row[j] = c[j];
+    }
+}
+
+using FixedSizeKernel = void(*)(MatrixView, MatrixView, MatrixView, MatMulMode);
+
+constexpr int max_fixed_size = 16;
+constexpr int fixed_size_table_dim = max_fixed_size + 1;
+
+using FixedSizeKernelTable = std::array<FixedSizeKernel, fixed_size_table_dim * fixed_size_table_dim * fixed_size_table_dim>;
+
+template<int N, int M, int... P>
+constexpr void add_fixed_size_kernels(FixedSizeKernelTable& table, std::integer_sequence<int, P...>)
+{
+    ((table[(N * fixed_size_table_dim + M) * fixed_size_table_dim + P] = &fixedSizeMatMul<N, M, P>), ...);
+}
+
+template<int N, int... M, class Ps>
+constexpr void add_fixed_size_kernels(FixedSizeKernelTable& table, std::integer_sequence<int, M...>, Ps ps)
+{
+    (add_fixed_size_kernels<N, M>(table, ps), ...);
+}
+
+// Kernels are instantiated for every square shape from 2 to 16 and every combination of 2, 4, 8 and 16
+inline constexpr FixedSizeKernelTable fixed_size_kernels = []
+{
+    FixedSizeKernelTable table{};
+
+    [&]<int... S>(std::integer_sequence<int, S...>)
+    {
+        (add_fixed_size_kernels<S + 2, S + 2>(table, std::integer_sequence<int, S + 2>{}), ...);
+    }(std::make_integer_sequence<int, max_fixed_size - 1>{});
+
+    using Powers = std::integer_sequence<int, 2, 4, 8, 16>;
+    [&]<int... N>(std::integer_sequence<int, N...>)
+    {
+        (add_fixed_size_kernels<N>(table, Powers{}, Powers{}), ...);
+    }(Powers{});
+
+    return table;
+}();
+
+inline FixedSizeKernel fixedSizeKernel(int n, int m, int p)
+{
+    if (n > max_fixed_size || m > max_fixed_size || p > max_fixed_size)
+        return nullptr;
+
+    return fixed_size_kernels[(n * fixed_size_table_dim + m) * fixed_size_table_dim + p];
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <span>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include "MatrixView.hpp"
+#include "PackedMatrix.hpp"
+
+// Per-element operations applied to C as it is written, called with the value and its row and column in C
+namespace epilogue
+{
+    struct Identity
+    {
+        int operator()(int value, int, int) const { return value; }
+    };
+
+    // Adds bias[column]
+    struct Bias
+    {
+        std::span<const int> bias;
+        int operator()(int value, int, int col) const { return int(std::uint32_t(value) + std::uint32_t(bias[col])); }
+    };
+
+    struct Clamp
+    {
+        int low, high;
+        int operator()(int value, int, int) const { return std::clamp(value, low, high); }
+    };
+
+    struct Relu
+    {
+        int operator()(int value, int, int) const { return std::max(value, 0); }
+    };
+
+    // value * multiplier / 2^shift rounded to nearest, plus zero_point, saturated to [low, high] (int8 by default):
+    // the requantization of int32 accumulators of quantized inputs to the output's scale
+    struct Requantize
+    {
+        std::int32_t multiplier;
+        int shift;
+        int zero_point = 0;
+        int low = -128, high = 127;
+
+        int operator()(int value, int, int) const
+        {
+            std::int64_t scaled = std::int64_t(value) * multiplier;
+            if (shift > 0) scaled = (scaled + (std::int64_t(1) << (shift - 1))) >> shift;
+            return int(std::clamp<std::int64_t>(scaled + zero_point, low, high));
+        }
+    };
+
+    // The steps one after the other, like compose(Bias{bias}, Relu{})
+    template<class... Steps>
+    struct Compose
+    {
+        std::tuple<Steps...> steps;
+
+        int operator()(int value, int row, int col) const
+        {
+            std::apply([&](const auto&... step) { ((value = step(value, row, col)), ...); }, steps);
+            return value;
+        }
+    };
+
+    template<class... Steps>
+    Compose<Steps...> compose(Steps... steps) { return {{steps...}}; }
+}
+
+// C = epilogue(alpha * A * B + beta * C), in the wrapping int arithmetic of the multiplications. With alpha 1,
+// beta 0 or 1 and no epilogue this is a single multiplier(A, B, C, mode) call. Otherwise C is done tile by tile:
+// with alpha 1 the product accumulates into the tile after it is scaled by beta (or overwrites it for beta 0),
+// else the product goes to a tile-sized scratch and is combined with the tile when it is written back. Either
+// way the epilogue is applied in the same write-back, while the tile is in cache, so there is no separate clear
+// or post-processing pass over C. Nothing happens if the shapes don't match.
+template<class F, class E = epilogue::Identity>
+void gemm(F multiplier, int alpha, MatrixView A, MatrixView B, int beta, MatrixView C, E epilogue = {}, int tile_size = PackedMatrix::default_block_size())
+{
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+    if (B.row_count() != m || C.row_count() != n || C.col_count() != p)
+        return;
+
+    constexpr bool identity = std::is_same_v<E, epilogue::Identity>;
+    if (identity && alpha == 1 && (beta == 0 || beta == 1))
+    {
+        multiplier(A, B, C, beta == 0 ? MatMulMode::Overwrite : MatMulMode::Add);
+        return;
+    }
+
+    tile_size = std::max(tile_size, 1);
+    std::vector<int> scratch;
+    if (alpha != 1 && alpha != 0)
+        scratch.resize(std::size_t(std::min(tile_size, n)) * std::min(tile_size, p));
+
+    for (int i = 0; i < n; i += tile_size)
+        for (int j = 0; j < p; j += tile_size)
+        {
+            int rows = std::min(tile_size, n - i), cols = std::min(tile_size, p - j);
+            MatrixView tile = C.getSubMatrix(i, i + rows, j, j + cols);
+            MatrixView A_rows = A.getSubMatrix(i, i + rows, 0, m);
+            MatrixView B_cols = B.getSubMatrix(0, m, j, j + cols);
+
+            if (alpha == 1)
+            {
+                if (beta != 0 && beta != 1)
+                    for (int r = 0; r < rows; r++)
+                    {
+                        int* out = tile.pointer(r, 0);
+                        cachesim::access(out, cols * sizeof(int), false);
+                        cachesim::access(out, cols * sizeof(int), true);
+                        for (int c = 0; c < cols; c++)
+                            out[c] = int(std::uint32_t(out[c]) * std::uint32_t(beta));
+                    }
+                multiplier(A_rows, B_cols, tile, beta == 0 ? MatMulMode::Overwrite : MatMulMode::Add);
+                if constexpr (!identity)
+                    for (int r = 0; r < rows; r++)
+                    {
+                        int* out = tile.pointer(r, 0);
+                        cachesim::access(out, cols * sizeof(int), false);
+                        cachesim::access(out, cols * sizeof(int), true);
+                        for (int c = 0; c < cols; c++)
+                            out[c] = epilogue(out[c], i + r, j + c);
+                    }
+                continue;
+            }
+
+            MatrixView product;
+            if (alpha != 0)
+            {
+                product = MatrixView(std::span<int>(scratch).first(std::size_t(rows) * cols), cols);
+                multiplier(A_rows, B_cols, product, MatMulMode::Overwrite);
+            }
+            for (int r = 0; r < rows; r++)
+            {
+                int* out = tile.pointer(r, 0);
+                const int* computed = alpha != 0 ? product.pointer(r, 0) : nullptr;
+                if (beta != 0) cachesim::access(out, cols * sizeof(int), false);
+                if (computed) cachesim::access(computed, cols * sizeof(int), false);
+                cachesim::access(out, cols * sizeof(int), true);
+                for (int c = 0; c < cols; c++)
+                {
+                    std::uint32_t value = beta != 0 ? std::uint32_t(out[c]) * std::uint32_t(beta) : 0;
+                    if (computed) value += std::uint32_t(computed[c]) * std::uint32_t(alpha);
+                    out[c] = epilogue(int(value), i + r, j + c);
+                }
+            }
+        }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 
 #ifdef _WIN32
     #include <windows.h>
@@ -52,4 +53,76 @@ size_t getL1CacheSize() {
 
     return l1CacheSize;
 #endif
-}
\ No newline at end of file
+}
+
+struct CacheLevelInfo
+{
+    int level;
+    size_t size;
+    size_t line_size;
+    size_t ways;
+};
+
+// Data (or unified) caches of the first core, one entry per level in increasing order
+std::vector<CacheLevelInfo> getCacheHierarchy() {
+    std::vector<CacheLevelInfo> levels;
+#ifdef _WIN32
+    DWORD bufferSize = 0;
+    GetLogicalProcessorInformationEx(RelationCache, nullptr, &bufferSize);
+
+    if (bufferSize == 0) return levels;
+
+    std::vector<uint8_t> buffer(bufferSize);
+    auto* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+
+    if (!GetLogicalProcessorInformationEx(RelationCache, info, &bufferSize)) {
+        return levels;
+    }
+
+    for (DWORD offset = 0; offset < bufferSize; offset += info->Size) {
+        if (info->Relationship == RelationCache && info->Cache.Type != CacheInstruction) {
+            bool known = false;
+            for (const auto& level : levels)
+                known = known || level.level == info->Cache.Level;
+            if (!known)
+                levels.push_back({info->Cache.Level, info->Cache.CacheSize, info->Cache.LineSize, info->Cache.Associativity});
+        }
+        info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(
+            reinterpret_cast<uint8_t*>(info) + info->Size);
+    }
+#else
+    auto read = [](const std::string& path) {
+        std::ifstream file(path);
+        std::string value;
+        file >> value;
+        return value;
+    };
+
+    for (int index = 0; ; index++) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+        std::string level = read(dir + "level");
+        if (level.empty()) break;
+        if (read(dir + "type") == "Instruction") continue;
+
+        // Convert "32K" or "2048K" or "32M" to bytes
+        std::string sizeStr = read(dir + "size");
+        if (sizeStr.empty()) continue;
+        size_t size = std::stoul(sizeStr);
+        if (sizeStr.back() == 'K' || sizeStr.back() == 'k') size *= 1024;
+        if (sizeStr.back() == 'M' || sizeStr.back() == 'm') size *= 1024 * 1024;
+
+        std::string line = read(dir + "coherency_line_size");
+        std::string ways = read(dir + "ways_of_associativity");
+        levels.push_back({std::stoi(level), size, line.empty() ? 64 : std::stoul(line), ways.empty() ? 1 : std::stoul(ways)});
+    }
+#endif
+    std::sort(levels.begin(), levels.end(), [](const auto& a, const auto& b) { return a.level < b.level; });
+    return levels;
+}
+
+size_t getCacheSize(int level) {
+    for (const auto& info : getCacheHierarchy())
+        if (info.level == level)
+            return info.size;
+    return 0;
+}
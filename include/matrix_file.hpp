@@ -0,0 +1,317 @@
+#pragma once
+#include <span>
+#include <string>
+#include <optional>
+#include <utility>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "MatrixView.hpp"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Binary matrix files: this 64 byte header, then the rows, leading_dimension elements apart, from data_offset
+// on. data_offset is a multiple of alignment and so is every row start when the file is written by
+// MappedMatrix::create. Everything is in the byte order of the machine that wrote the file.
+struct MatrixFileHeader
+{
+    static constexpr char expected_magic[8] = {'M', 'A', 'T', 'M', 'U', 'L', '\0', '\1'};
+    enum ElementType : std::uint32_t { Int32 = 1 };
+
+    char magic[8];
+    std::uint32_t element_type;
+    std::uint32_t element_size;      // bytes
+    std::uint64_t rows;
+    std::uint64_t cols;
+    std::uint64_t leading_dimension; // elements from the start of one row to the next, at least cols
+    std::uint64_t alignment;         // bytes, a power of two
+    std::uint64_t data_offset;       // bytes from the start of the file
+    std::uint64_t reserved;
+
+    // Header of a new rows x cols file, with rows padded to multiples of alignment (a power of two, at least
+    // the element size)
+    static MatrixFileHeader make(std::uint64_t rows, std::uint64_t cols, std::uint64_t alignment = 64)
+    {
+        MatrixFileHeader header{};
+        std::memcpy(header.magic, expected_magic, sizeof(header.magic));
+        header.element_type = Int32;
+        header.element_size = sizeof(int);
+        header.rows = rows;
+        header.cols = cols;
+        std::uint64_t row_alignment = std::max<std::uint64_t>(alignment / sizeof(int), 1);
+        header.leading_dimension = (cols + row_alignment - 1) / row_alignment * row_alignment;
+        header.alignment = alignment;
+        header.data_offset = (sizeof(MatrixFileHeader) + alignment - 1) / alignment * alignment;
+        return header;
+    }
+
+    std::uint64_t file_size() const { return data_offset + rows * leading_dimension * element_size; }
+
+    bool valid(std::uint64_t file_size) const
+    {
+        return std::memcmp(magic, expected_magic, sizeof(magic)) == 0 &&
+               element_type == Int32 && element_size == sizeof(int) &&
+               leading_dimension >= cols && rows < (std::uint64_t(1) << 31) && leading_dimension < (std::uint64_t(1) << 31) &&
+               alignment >= element_size && (alignment & (alignment - 1)) == 0 &&
+               data_offset >= sizeof(MatrixFileHeader) && data_offset % alignment == 0 &&
+               data_offset <= file_size && rows * leading_dimension <= (file_size - data_offset) / element_size;
+    }
+
+    // Whether a MatrixView, which indexes with int, can view the whole matrix
+    bool viewable() const
+    {
+        return rows * leading_dimension <= INT_MAX;
+    }
+};
+static_assert(sizeof(MatrixFileHeader) == 64);
+
+// A matrix file mapped into memory, viewed in place without copying. Files are unmapped when the
+// MappedMatrix is destroyed. Only available on POSIX systems, elsewhere open and create fail.
+class MappedMatrix
+{
+    void* mapping = nullptr;
+    std::size_t mapping_size = 0;
+    MatrixFileHeader header{};
+
+    MappedMatrix(void* mapping, std::size_t mapping_size, const MatrixFileHeader& header)
+        : mapping(mapping), mapping_size(mapping_size), header(header)
+    {
+    }
+
+#ifndef _WIN32
+    static std::optional<MappedMatrix> map(int fd, std::size_t size, int protection, int flags)
+    {
+        void* mapping = mmap(nullptr, size, protection, flags, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            return std::nullopt;
+
+        MatrixFileHeader header;
+        std::memcpy(&header, mapping, sizeof(header));
+        if (!header.valid(size) || !header.viewable())
+        {
+            munmap(mapping, size);
+            return std::nullopt;
+        }
+        return MappedMatrix(mapping, size, header);
+    }
+#endif
+
+public:
+    MappedMatrix(MappedMatrix&& other) noexcept
+        : mapping(std::exchange(other.mapping, nullptr)), mapping_size(std::exchange(other.mapping_size, 0)), header(other.header)
+    {
+    }
+
+    MappedMatrix& operator=(MappedMatrix other) noexcept
+    {
+        std::swap(mapping, other.mapping);
+        std::swap(mapping_size, other.mapping_size);
+        std::swap(header, other.header);
+        return *this;
+    }
+
+    ~MappedMatrix()
+    {
+#ifndef _WIN32
+        if (mapping)
+            munmap(mapping, mapping_size);
+#endif
+    }
+
+    int row_count() const { return int(header.rows); }
+    int col_count() const { return int(header.cols); }
+
+    // Every row with its padding up to the leading dimension
+    std::span<int> data() const
+    {
+        return {reinterpret_cast<int*>(static_cast<char*>(mapping) + header.data_offset), std::size_t(header.rows * header.leading_dimension)};
+    }
+
+    MatrixView view() const
+    {
+        return MatrixView(data(), int(header.leading_dimension), 0, row_count(), 0, col_count());
+    }
+
+    // Writes the changes of a mapping made by create to the file now instead of at some point after
+    void flush() const
+    {
+#ifndef _WIN32
+        msync(mapping, mapping_size, MS_SYNC);
+#endif
+    }
+
+    // Maps path copy-on-write: the view can be written, but the changes never reach the file
+    static std::optional<MappedMatrix> open(const std::string& path)
+    {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return std::nullopt;
+
+        struct stat status;
+        if (fstat(fd, &status) != 0 || std::size_t(status.st_size) < sizeof(MatrixFileHeader))
+        {
+            ::close(fd);
+            return std::nullopt;
+        }
+        return map(fd, std::size_t(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE);
+#else
+        return std::nullopt;
+#endif
+    }
+
+    // Creates (or replaces) path with a rows x cols matrix of zeros and maps it shared, so what is written
+    // through the view ends up in the file. Rows are padded so every one starts at a multiple of alignment.
+    static std::optional<MappedMatrix> create(const std::string& path, int rows, int cols, std::size_t alignment = 64)
+    {
+#ifndef _WIN32
+        if (rows < 0 || cols < 0)
+            return std::nullopt;
+
+        MatrixFileHeader header = MatrixFileHeader::make(std::uint64_t(rows), std::uint64_t(cols), alignment);
+        std::size_t size = header.file_size();
+        if (!header.valid(size) || !header.viewable())
+            return std::nullopt;
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return std::nullopt;
+        if (ftruncate(fd, off_t(size)) != 0 || pwrite(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)))
+        {
+            ::close(fd);
+            return std::nullopt;
+        }
+        return map(fd, size, PROT_READ | PROT_WRITE, MAP_SHARED);
+#else
+        return std::nullopt;
+#endif
+    }
+};
+
+// A matrix file read and written a tile at a time with pread and pwrite, for matrices too big to map or to
+// keep in memory. Tiles are row-major in the given buffer, rows x cols from (row, col) of the matrix. Only
+// available on POSIX systems, elsewhere open and create fail.
+class MatrixFile
+{
+    int fd = -1;
+    MatrixFileHeader header{};
+
+    MatrixFile(int fd, const MatrixFileHeader& header) : fd(fd), header(header) {}
+
+    std::uint64_t offset(std::uint64_t row, std::uint64_t col) const
+    {
+        return header.data_offset + (row * header.leading_dimension + col) * sizeof(int);
+    }
+
+public:
+    MatrixFile(MatrixFile&& other) noexcept : fd(std::exchange(other.fd, -1)), header(other.header) {}
+
+    MatrixFile& operator=(MatrixFile other) noexcept
+    {
+        std::swap(fd, other.fd);
+        std::swap(header, other.header);
+        return *this;
+    }
+
+    ~MatrixFile()
+    {
+#ifndef _WIN32
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+
+    std::uint64_t row_count() const { return header.rows; }
+    std::uint64_t col_count() const { return header.cols; }
+
+    bool read(std::uint64_t row, std::uint64_t col, int rows, int cols, std::span<int> tile) const
+    {
+#ifndef _WIN32
+        for (int i = 0; i < rows; i++)
+        {
+            auto bytes = reinterpret_cast<char*>(tile.data() + std::size_t(i) * cols);
+            std::size_t size = std::size_t(cols) * sizeof(int), done = 0;
+            while (done < size)
+            {
+                ssize_t count = pread(fd, bytes + done, size - done, off_t(offset(row + i, col) + done));
+                if (count <= 0)
+                    return false;
+                done += std::size_t(count);
+            }
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool write(std::uint64_t row, std::uint64_t col, int rows, int cols, std::span<const int> tile) const
+    {
+#ifndef _WIN32
+        for (int i = 0; i < rows; i++)
+        {
+            auto bytes = reinterpret_cast<const char*>(tile.data() + std::size_t(i) * cols);
+            std::size_t size = std::size_t(cols) * sizeof(int), done = 0;
+            while (done < size)
+            {
+                ssize_t count = pwrite(fd, bytes + done, size - done, off_t(offset(row + i, col) + done));
+                if (count <= 0)
+                    return false;
+                done += std::size_t(count);
+            }
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static std::optional<MatrixFile> open(const std::string& path, bool writable = false)
+    {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fd < 0)
+            return std::nullopt;
+
+        MatrixFileHeader header;
+        struct stat status;
+        if (fstat(fd, &status) != 0 || pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) || !header.valid(std::uint64_t(status.st_size)))
+        {
+            ::close(fd);
+            return std::nullopt;
+        }
+        return MatrixFile(fd, header);
+#else
+        return std::nullopt;
+#endif
+    }
+
+    // Creates (or replaces) path with a rows x cols matrix of zeros, sparse where the file system allows
+    static std::optional<MatrixFile> create(const std::string& path, std::uint64_t rows, std::uint64_t cols, std::size_t alignment = 64)
+    {
+#ifndef _WIN32
+        MatrixFileHeader header = MatrixFileHeader::make(rows, cols, alignment);
+        if (!header.valid(header.file_size()))
+            return std::nullopt;
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return std::nullopt;
+        if (ftruncate(fd, off_t(header.file_size())) != 0 || pwrite(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)))
+        {
+            ::close(fd);
+            return std::nullopt;
+        }
+        return MatrixFile(fd, header);
+#else
+        return std::nullopt;
+#endif
+    }
+};
@@ -0,0 +1,168 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include "MatrixView.hpp"
+#include "getL1CacheSize.hpp"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+#endif
+
+namespace detail
+{
+    // Splits the rows [0, n) into thread_count contiguous ranges and runs f on each one
+    template<class F>
+    void parallel_rows(int n, int thread_count, F f)
+    {
+        thread_count = std::clamp(thread_count, 1, std::max(n, 1));
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count - 1);
+        for (int t = 1; t < thread_count; t++)
+            threads.emplace_back(f, int(std::int64_t(n) * t / thread_count), int(std::int64_t(n) * (t + 1) / thread_count));
+
+        f(0, n / thread_count);
+
+        for (auto& thread : threads) thread.join();
+    }
+
+    // Columns of C processed together, so that the row of 64 bit accumulators stays in L1
+    inline int accumulator_block_size()
+    {
+        return std::max<int>(64, getL1CacheSize() / sizeof(std::uint64_t) / 2);
+    }
+}
+
+// C = A * B (or C += A * B) with 64 bit accumulation, exact as long as every partial sum fits in int64_t
+inline void wideMatMul(MatrixView A, MatrixView B, WideMatrixView C, MatMulMode mode, int thread_count = std::thread::hardware_concurrency())
+{
+    if (A.col_count() != B.row_count() || B.col_count() != C.col_count() || A.row_count() != C.row_count()) // Invalid matrix dimensions
+        return;
+
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+    int block = detail::accumulator_block_size();
+
+    detail::parallel_rows(n, thread_count, [&](int begin, int end)
+    {
+        for (int j0 = 0; j0 < p; j0 += block)
+        {
+            int j1 = std::min(j0 + block, p);
+            for (int i = begin; i < end; i++)
+            {
+                std::int64_t* c = C.pointer(i, j0) - j0;
+                if (mode == MatMulMode::Overwrite)
+                    std::fill(c + j0, c + j1, 0);
+
+                for (int k = 0; k < m; k++)
+                {
+                    std::int64_t a = A(i, k);
+                    const int* b = B.pointer(k, 0);
+                    for (int j = j0; j < j1; j++)
+                        c[j] += a * b[j];
+                }
+            }
+        }
+    });
+}
+
+// Barrett reduction of 64 bit values modulo a modulus below 2^31
+struct BarrettReducer
+{
+    std::uint64_t modulus;
+    std::uint64_t inverse; // floor(2^64 / modulus)
+
+    explicit BarrettReducer(std::uint32_t modulus)
+        : modulus(modulus), inverse(modulus > 1 ? ~std::uint64_t(0) / modulus : 0)
+    {
+    }
+
+    std::uint64_t reduce(std::uint64_t x) const
+    {
+        if (modulus == 1)
+            return 0;
+
+        std::uint64_t r = x - mulhi(x, inverse) * modulus;
+        return r >= modulus ? r - modulus : r;
+    }
+
+    static std::uint64_t mulhi(std::uint64_t a, std::uint64_t b)
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        return __umulh(a, b);
+#else
+        return std::uint64_t((unsigned __int128)a * b >> 64);
+#endif
+    }
+};
+
+// C = A * B mod modulus (or C = C + A * B mod modulus), exact for any modulus in [1, 2^31).
+// Products are accumulated in 64 bits and only reduced once the next products could overflow the
+// accumulator, which for moduli below 2^16 means never before the end of the row.
+inline void modularMatMul(MatrixView A, MatrixView B, MatrixView C, std::uint32_t modulus, MatMulMode mode, int thread_count = std::thread::hardware_concurrency())
+{
+    if (A.col_count() != B.row_count() || B.col_count() != C.col_count() || A.row_count() != C.row_count()) // Invalid matrix dimensions
+        return;
+    if (modulus == 0 || modulus > std::uint32_t(INT32_MAX)) // Residues must fit in int
+        return;
+
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+    BarrettReducer reducer(modulus);
+
+    auto residue = [modulus](int x) { return std::uint64_t((std::int64_t(x) % modulus + modulus) % modulus); };
+
+    // Operands reduced once, so every product is below (modulus - 1)^2
+    std::vector<std::uint32_t> a_mod(std::size_t(n) * m), b_mod(std::size_t(m) * p);
+    detail::parallel_rows(n, thread_count, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+            for (int k = 0; k < m; k++)
+                a_mod[std::size_t(i) * m + k] = residue(A(i, k));
+    });
+    detail::parallel_rows(m, thread_count, [&](int begin, int end)
+    {
+        for (int k = begin; k < end; k++)
+            for (int j = 0; j < p; j++)
+                b_mod[std::size_t(k) * p + j] = residue(B(k, j));
+    });
+
+    // Number of products that can be added to a reduced accumulator without overflowing 64 bits
+    std::uint64_t max_product = std::uint64_t(modulus - 1) * (modulus - 1);
+    std::uint64_t lazy_steps = max_product == 0 ? std::uint64_t(m) + 1 : (~std::uint64_t(0) - (modulus - 1)) / max_product;
+    int reduce_every = int(std::clamp<std::uint64_t>(lazy_steps, 1, std::uint64_t(m) + 1));
+
+    int block = detail::accumulator_block_size();
+
+    detail::parallel_rows(n, thread_count, [&](int begin, int end)
+    {
+        std::vector<std::uint64_t> acc(block);
+        for (int j0 = 0; j0 < p; j0 += block)
+        {
+            int width = std::min(block, p - j0);
+            for (int i = begin; i < end; i++)
+            {
+                for (int j = 0; j < width; j++)
+                    acc[j] = mode == MatMulMode::Add ? residue(C(i, j0 + j)) : 0;
+
+                const std::uint32_t* a = &a_mod[std::size_t(i) * m];
+                for (int k0 = 0; k0 < m; k0 += reduce_every)
+                {
+                    int k1 = std::min(m, k0 + reduce_every);
+                    for (int k = k0; k < k1; k++)
+                    {
+                        std::uint64_t a_ik = a[k];
+                        const std::uint32_t* b = &b_mod[std::size_t(k) * p + j0];
+                        for (int j = 0; j < width; j++)
+                            acc[j] += a_ik * b[j];
+                    }
+                    if (k1 < m)
+                        for (int j = 0; j < width; j++)
+                            acc[j] = reducer.reduce(acc[j]);
+                }
+
+                for (int j = 0; j < width; j++)
+                    C(i, j0 + j) = int(reducer.reduce(acc[j]));
+            }
+        }
+    });
+}
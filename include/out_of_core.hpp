@@ -0,0 +1,201 @@
+#pragma once
+#include <vector>
+#include <future>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include "MatrixView.hpp"
+#include "matrix_file.hpp"
+
+struct OutOfCoreTiling
+{
+    int rows;  // of a C tile
+    int cols;
+    int depth; // columns of an A panel, rows of a B panel
+};
+
+struct OutOfCoreStats
+{
+    bool ok = false;
+    OutOfCoreTiling tiling{};
+    std::uint64_t bytes_read = 0;
+    std::uint64_t bytes_written = 0;
+    double io_wait = 0; // seconds the multiplication waited for reads and writes
+};
+
+// C tiles of t x t and panels t / 2 deep, with t as large as memory_bytes allows for the 4 t^2 elements of
+// buffers: the C tile being computed and the one being written back, and the current and the prefetched
+// panels of A and B. Every panel is read about N / t (B) or P / t (A) times, so bigger tiles mean less I/O.
+inline OutOfCoreTiling outOfCoreTiling(std::uint64_t N, std::uint64_t M, std::uint64_t P, std::size_t memory_bytes)
+{
+    int t = int(std::min(std::sqrt(double(memory_bytes) / (4 * sizeof(int))), double(1 << 15)));
+    if (t >= 128) t -= t % 64;
+    t = std::max(t, 2);
+    return {int(std::clamp<std::uint64_t>(N, 1, t)), int(std::clamp<std::uint64_t>(P, 1, t)), int(std::clamp<std::uint64_t>(M, 1, t / 2))};
+}
+
+// C = A * B (or C += A * B) for matrix files of any size, using about memory_bytes of buffers (see
+// outOfCoreTiling). One C tile at a time stays in memory while the panels of A and B it needs stream by,
+// and multiplier (in-memory, e.g. a MatrixMultiplier made for the tile shape) multiplies them. The tiles
+// are visited in a snake order and consecutive tiles walk the panels in opposite directions, so the last A
+// or B panel of a tile is also the first of the next one and isn't read again. The next panels are read
+// and the previous C tile is written asynchronously while the current panels are multiplied.
+template<class F>
+OutOfCoreStats outOfCoreMatMul(const MatrixFile& A, const MatrixFile& B, const MatrixFile& C, MatMulMode mode, std::size_t memory_bytes, F multiplier)
+{
+    OutOfCoreStats stats;
+    std::uint64_t N = A.row_count(), M = A.col_count(), P = B.col_count();
+    if (B.row_count() != M || C.row_count() != N || C.col_count() != P)
+        return stats;
+
+    OutOfCoreTiling tiling = stats.tiling = outOfCoreTiling(N, M, P, memory_bytes);
+    std::uint64_t tile_rows = (N + tiling.rows - 1) / tiling.rows;
+    std::uint64_t tile_cols = (P + tiling.cols - 1) / tiling.cols;
+    std::uint64_t depth_count = (M + tiling.depth - 1) / tiling.depth;
+
+    struct Step
+    {
+        std::uint64_t tile;
+        std::uint64_t i, j, k; // origins in C (i, j) and the shared dimension (k)
+    };
+    std::vector<Step> steps;
+    std::vector<std::array<std::uint64_t, 2>> tiles;
+    for (std::uint64_t ti = 0; ti < tile_rows; ti++)
+        for (std::uint64_t tj = 0; tj < tile_cols; tj++)
+        {
+            std::uint64_t j = (ti % 2 ? tile_cols - 1 - tj : tj) * tiling.cols;
+            for (std::uint64_t tk = 0; tk < depth_count; tk++)
+                steps.push_back({tiles.size(), ti * tiling.rows, j, (tiles.size() % 2 ? depth_count - 1 - tk : tk) * tiling.depth});
+            tiles.push_back({ti * tiling.rows, j});
+        }
+
+    auto rows_at = [&](std::uint64_t i) { return int(std::min<std::uint64_t>(tiling.rows, N - i)); };
+    auto cols_at = [&](std::uint64_t j) { return int(std::min<std::uint64_t>(tiling.cols, P - j)); };
+    auto depth_at = [&](std::uint64_t k) { return int(std::min<std::uint64_t>(tiling.depth, M - k)); };
+
+    struct Panel
+    {
+        std::vector<int> data;
+        std::uint64_t row = ~std::uint64_t(0), col = ~std::uint64_t(0);
+    };
+    // Reads the panel at (row, col) into panel unless it is already there, returns the bytes read or -1
+    auto load = [](const MatrixFile& file, Panel& panel, std::uint64_t row, std::uint64_t col, int rows, int cols) -> std::int64_t
+    {
+        if (panel.row == row && panel.col == col)
+            return 0;
+        panel.row = panel.col = ~std::uint64_t(0);
+        panel.data.resize(std::size_t(rows) * cols);
+        if (!file.read(row, col, rows, cols, panel.data))
+            return -1;
+        panel.row = row;
+        panel.col = col;
+        return std::int64_t(panel.data.size() * sizeof(int));
+    };
+
+    std::array<Panel, 2> a, b;
+    std::array<std::vector<int>, 2> c;
+    int a_current = 1, b_current = 1, c_current = 0;
+    int a_next = 0, b_next = 0;
+
+    auto wait = [&](auto& future)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto result = future.get();
+        stats.io_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    };
+
+    // A panel that the step being multiplied uses stays in its slot, the other slot is free for the next one
+    auto prefetch = [&](const Step& step)
+    {
+        a_next = a[a_current].row == step.i && a[a_current].col == step.k ? a_current : 1 - a_current;
+        b_next = b[b_current].row == step.k && b[b_current].col == step.j ? b_current : 1 - b_current;
+        return std::async(std::launch::async, [&, step, a_slot = a_next, b_slot = b_next]() -> std::int64_t
+        {
+            std::int64_t a_bytes = load(A, a[a_slot], step.i, step.k, rows_at(step.i), depth_at(step.k));
+            std::int64_t b_bytes = load(B, b[b_slot], step.k, step.j, depth_at(step.k), cols_at(step.j));
+            return a_bytes < 0 || b_bytes < 0 ? -1 : a_bytes + b_bytes;
+        });
+    };
+
+    std::future<bool> writing;
+    auto write_tile = [&](std::uint64_t tile)
+    {
+        if (writing.valid() && !wait(writing))
+            return false;
+        auto [i, j] = tiles[tile];
+        stats.bytes_written += c[c_current].size() * sizeof(int);
+        writing = std::async(std::launch::async, [&C, &buffer = c[c_current], i, j, rows = rows_at(i), cols = cols_at(j)]
+        {
+            return C.write(i, j, rows, cols, buffer);
+        });
+        c_current = 1 - c_current;
+        return true;
+    };
+
+    // Nothing to multiply: C = 0 or stays as it is
+    if (steps.empty())
+    {
+        if (mode == MatMulMode::Add)
+        {
+            stats.ok = true;
+            return stats;
+        }
+        for (std::uint64_t tile = 0; tile < tiles.size(); tile++)
+        {
+            c[c_current].assign(std::size_t(rows_at(tiles[tile][0])) * cols_at(tiles[tile][1]), 0);
+            if (!write_tile(tile))
+                return stats;
+        }
+        stats.ok = wait(writing);
+        return stats;
+    }
+
+    std::future<std::int64_t> fetching = prefetch(steps.front());
+    for (std::size_t s = 0; s < steps.size(); s++)
+    {
+        const Step& step = steps[s];
+        int rows = rows_at(step.i), cols = cols_at(step.j);
+        bool first = s == 0 || steps[s - 1].tile != step.tile;
+        bool last = s + 1 == steps.size() || steps[s + 1].tile != step.tile;
+
+        if (first)
+        {
+            c[c_current].resize(std::size_t(rows) * cols);
+            if (mode == MatMulMode::Add)
+            {
+                auto start = std::chrono::steady_clock::now();
+                bool read = C.read(step.i, step.j, rows, cols, c[c_current]);
+                stats.io_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (!read)
+                    return stats;
+                stats.bytes_read += c[c_current].size() * sizeof(int);
+            }
+        }
+
+        std::int64_t bytes = wait(fetching);
+        if (bytes < 0)
+            return stats;
+        stats.bytes_read += std::uint64_t(bytes);
+        a_current = a_next;
+        b_current = b_next;
+
+        if (s + 1 < steps.size())
+            fetching = prefetch(steps[s + 1]);
+
+        multiplier(MatrixView(a[a_current].data, depth_at(step.k)),
+                   MatrixView(b[b_current].data, cols),
+                   MatrixView(c[c_current], cols),
+                   first && mode == MatMulMode::Overwrite ? MatMulMode::Overwrite : MatMulMode::Add);
+
+        if (last && !write_tile(step.tile))
+        {
+            if (fetching.valid()) fetching.wait();
+            return stats;
+        }
+    }
+
+    stats.ok = wait(writing);
+    return stats;
+}
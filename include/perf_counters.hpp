@@ -0,0 +1,154 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <format>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+struct CounterSpec
+{
+    std::string name;
+    std::uint32_t type;
+    std::uint64_t config;
+};
+
+// Linux perf_event_open counters of the calling thread and every thread it starts while they are enabled.
+// Each counter is opened on its own, so counters the CPU (or the kernel's perf_event_paranoid setting)
+// doesn't allow are simply reported as unavailable. On other platforms nothing is available.
+class PerfCounters
+{
+    std::vector<CounterSpec> specs;
+    std::vector<int> fds;
+
+public:
+    // cycles, instructions, l1d-misses, llc-misses, dtlb-misses, page-faults, or raw=<hex config> for a CPU
+    // specific event such as the vector instruction counts
+    static std::optional<CounterSpec> parse(std::string_view name)
+    {
+#ifdef __linux__
+        auto cache = [](std::uint64_t cache, std::uint64_t result) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+        };
+        if (name == "cycles")       return CounterSpec{"cycles",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+        if (name == "instructions") return CounterSpec{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS};
+        if (name == "l1d-misses")   return CounterSpec{"l1d-misses",   PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D,  PERF_COUNT_HW_CACHE_RESULT_MISS)};
+        if (name == "llc-misses")   return CounterSpec{"llc-misses",   PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL,   PERF_COUNT_HW_CACHE_RESULT_MISS)};
+        if (name == "dtlb-misses")  return CounterSpec{"dtlb-misses",  PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS)};
+        if (name == "page-faults")  return CounterSpec{"page-faults",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS};
+        if (name.starts_with("raw="))
+        {
+            try
+            {
+                return CounterSpec{std::string(name), PERF_TYPE_RAW, std::stoull(std::string(name.substr(4)), nullptr, 16)};
+            }
+            catch (std::exception&)
+            {
+                return std::nullopt;
+            }
+        }
+#endif
+        return std::nullopt;
+    }
+
+    static std::vector<std::string> default_names()
+    {
+        return {"cycles", "instructions", "l1d-misses", "llc-misses", "dtlb-misses", "page-faults"};
+    }
+
+    explicit PerfCounters(std::vector<CounterSpec> counters) : specs(std::move(counters))
+    {
+        for (const auto& spec : specs)
+            fds.push_back(open(spec));
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int fd : fds)
+            if (fd >= 0) close(fd);
+#endif
+    }
+
+    const std::vector<CounterSpec>& counters() const { return specs; }
+
+    bool any_available() const
+    {
+        for (int fd : fds)
+            if (fd >= 0) return true;
+        return false;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        for (int fd : fds)
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        for (int fd : fds)
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    // Values since start(), scaled up if the kernel had to multiplex the counters
+    std::vector<std::optional<double>> read() const
+    {
+        std::vector<std::optional<double>> values(fds.size());
+#ifdef __linux__
+        for (std::size_t i = 0; i < fds.size(); i++)
+        {
+            std::uint64_t data[3]; // value, time enabled, time running
+            if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != sizeof(data))
+                continue;
+            values[i] = data[2] == 0 ? 0.0 : double(data[0]) * data[1] / data[2];
+        }
+#endif
+        return values;
+    }
+
+private:
+    static int open(const CounterSpec& spec)
+    {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = spec.type;
+        attr.config = spec.config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        return -1;
+#endif
+    }
+};
+
+// 1234567 -> "1.23M"
+std::string format_count(double value)
+{
+    if (value >= 1e9) return std::format("{:.3g}G", value / 1e9);
+    if (value >= 1e6) return std::format("{:.3g}M", value / 1e6);
+    if (value >= 1e3) return std::format("{:.3g}K", value / 1e3);
+    return std::format("{:.3g}", value);
+}
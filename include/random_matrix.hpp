@@ -0,0 +1,33 @@
+#pragma once
+#include <span>
+#include <thread>
+#include <cstdint>
+#include "modular.hpp"
+
+// Counter-based random numbers: the i-th number of a stream is a hash (SplitMix64's finalizer) of the stream's
+// key and i, so any part of a stream can be generated independently, in any order and by any thread.
+inline std::uint64_t counterRandom(std::uint64_t key, std::uint64_t counter)
+{
+    std::uint64_t z = key + (counter + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Fills data with numbers in [min, max] from stream `stream` of seed, in parallel. The result only depends on
+// seed and stream, never on the number of threads.
+void randomFill(std::span<int> data, std::uint64_t seed, std::uint64_t stream, int min = 0, int max = 100,
+                int thread_count = std::thread::hardware_concurrency())
+{
+    constexpr int chunk = 1 << 16;
+    std::uint64_t key = counterRandom(seed, stream);
+    std::uint64_t range = std::uint64_t(std::int64_t(max) - min + 1);
+    int chunk_count = int((data.size() + chunk - 1) / chunk);
+
+    detail::parallel_rows(chunk_count, thread_count, [&](int begin, int end)
+    {
+        std::size_t last = std::min(data.size(), std::size_t(end) * chunk);
+        for (std::size_t i = std::size_t(begin) * chunk; i < last; i++)
+            data[i] = int(min + std::int64_t((counterRandom(key, i) >> 32) * range >> 32)); // range < 2^32, bias below 2^-32 * range
+    });
+}
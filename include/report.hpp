@@ -0,0 +1,362 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <variant>
+#include <optional>
+#include <span>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <format>
+#include <cmath>
+#include "benchmark.hpp"
+
+// One measured (multiplier, shape, mode, thread count) point
+struct BenchmarkRecord
+{
+    std::string multiplier;  // short name, as accepted by --mult
+    std::string name;
+    int n = 0, m = 0, p = 0;
+    std::string mode;        // "overwrite" or "add"
+    int threads = 1;
+    TimingStats stats;
+    double gops = 0;
+    double gbps = 0;
+    std::optional<bool> check;
+    std::vector<std::pair<std::string, std::optional<double>>> counters; // per call
+
+    auto key() const { return std::tuple{multiplier, n, m, p, mode, threads}; }
+};
+
+namespace report
+{
+    inline std::string escape(std::string_view text)
+    {
+        std::string result;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+        return result;
+    }
+
+    inline std::string trim(std::string_view text)
+    {
+        auto begin = text.find_first_not_of(' ');
+        auto end = text.find_last_not_of(' ');
+        return begin == std::string_view::npos ? std::string{} : std::string(text.substr(begin, end - begin + 1));
+    }
+
+    inline void write_json(std::ostream& out, const std::vector<BenchmarkRecord>& records)
+    {
+        out << "{\n  \"results\": [";
+        for (bool first = true; const auto& r : records)
+        {
+            out << (first ? "\n" : ",\n");
+            first = false;
+            out << std::format("    {{\"multiplier\": \"{}\", \"name\": \"{}\", \"n\": {}, \"m\": {}, \"p\": {}, \"mode\": \"{}\", \"threads\": {}, "
+                               "\"median_s\": {:.9g}, \"min_s\": {:.9g}, \"mean_s\": {:.9g}, \"stddev_s\": {:.9g}, \"samples\": {}, \"calls_per_sample\": {}, "
+                               "\"gops\": {:.6g}, \"gbps\": {:.6g}, \"verified\": {}",
+                escape(r.multiplier), escape(trim(r.name)), r.n, r.m, r.p, r.mode, r.threads,
+                r.stats.median, r.stats.min, r.stats.mean, r.stats.stddev, r.stats.samples, r.stats.calls_per_sample,
+                r.gops, r.gbps, r.check ? (*r.check ? "true" : "false") : "null");
+            if (!r.counters.empty())
+            {
+                out << ", \"counters\": {";
+                for (bool first_counter = true; const auto& [name, value] : r.counters)
+                {
+                    out << std::format("{}\"{}\": {}", first_counter ? "" : ", ", escape(name), value ? std::format("{:.6g}", *value) : "null");
+                    first_counter = false;
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    inline void write_csv(std::ostream& out, const std::vector<BenchmarkRecord>& records)
+    {
+        out << "multiplier,name,n,m,p,mode,threads,median_s,min_s,mean_s,stddev_s,samples,calls_per_sample,gops,gbps,verified";
+        if (!records.empty())
+            for (const auto& [name, value] : records.front().counters)
+                out << "," << name;
+        out << "\n";
+
+        for (const auto& r : records)
+        {
+            out << std::format("{},\"{}\",{},{},{},{},{},{:.9g},{:.9g},{:.9g},{:.9g},{},{},{:.6g},{:.6g},{}",
+                r.multiplier, trim(r.name), r.n, r.m, r.p, r.mode, r.threads,
+                r.stats.median, r.stats.min, r.stats.mean, r.stats.stddev, r.stats.samples, r.stats.calls_per_sample,
+                r.gops, r.gbps, r.check ? (*r.check ? "true" : "false") : "");
+            for (const auto& [name, value] : r.counters)
+                out << "," << (value ? std::format("{:.6g}", *value) : "");
+            out << "\n";
+        }
+    }
+
+    // Speedup and parallel efficiency of every multiplier measured with more than one thread count, relative to
+    // its point with the fewest threads. For weak scaling the work grows with the threads, so both come from
+    // throughput: speedup = GOP/s / base GOP/s, efficiency = speedup / (threads / base threads).
+    inline void print_scaling(std::ostream& out, std::span<const BenchmarkRecord> records, bool weak)
+    {
+        std::map<std::pair<std::string, std::string>, std::vector<const BenchmarkRecord*>> groups;
+        for (const auto& r : records)
+            groups[{r.multiplier, r.mode}].push_back(&r);
+
+        for (auto& [key, points] : groups)
+        {
+            if (points.size() < 2)
+                continue;
+
+            std::ranges::sort(points, {}, &BenchmarkRecord::threads);
+            const BenchmarkRecord& base = *points.front();
+            out << std::format("    {} scaling of {} ({}):", weak ? "Weak" : "Strong", key.first, key.second == "overwrite" ? "OWT" : "ADD");
+            for (bool first = true; const BenchmarkRecord* r : points)
+            {
+                double speedup = base.gops > 0 ? r->gops / base.gops : 0;
+                double efficiency = speedup * base.threads / r->threads;
+                out << std::format("{} {}t {:.2f}x {:.0f}%", first ? "" : " |", r->threads, speedup, efficiency * 100);
+                first = false;
+            }
+            out << '\n';
+        }
+    }
+
+    // Throughput of every other point as a percentage of the baseline multiplier's point of the same mode
+    inline void print_relative(std::ostream& out, std::span<const BenchmarkRecord> records, std::string_view baseline)
+    {
+        for (std::string_view mode : {"overwrite", "add"})
+        {
+            auto base = std::ranges::find_if(records, [&](const BenchmarkRecord& r){ return r.multiplier == baseline && r.mode == mode; });
+            if (base == records.end() || base->gops <= 0)
+                continue;
+
+            out << std::format("    % of {} ({}):", baseline, mode == "overwrite" ? "OWT" : "ADD");
+            for (bool first = true; const auto& r : records)
+            {
+                if (r.mode != mode || &r == &*base)
+                    continue;
+                bool several = std::ranges::count_if(records, [&](const BenchmarkRecord& other){ return other.multiplier == r.multiplier && other.mode == mode; }) > 1;
+                std::string label = several ? std::format("{}x{}", r.multiplier, r.threads) : r.multiplier;
+                out << std::format("{} {} {:.1f}%", first ? "" : " |", label, r.gops / base->gops * 100);
+                first = false;
+            }
+            out << '\n';
+        }
+    }
+
+    // Just enough of JSON to read back what write_json produces
+    struct JsonValue
+    {
+        using Array = std::vector<JsonValue>;
+        using Object = std::vector<std::pair<std::string, JsonValue>>;
+        std::variant<std::nullptr_t, bool, double, std::string, Array, Object> value;
+
+        const JsonValue* get(const std::string& key) const
+        {
+            auto object = std::get_if<Object>(&value);
+            if (!object) return nullptr;
+            for (const auto& [name, member] : *object)
+                if (name == key)
+                    return &member;
+            return nullptr;
+        }
+        double number(const std::string& key, double fallback = 0) const
+        {
+            auto v = get(key);
+            return v && std::holds_alternative<double>(v->value) ? std::get<double>(v->value) : fallback;
+        }
+        std::string string(const std::string& key) const
+        {
+            auto v = get(key);
+            return v && std::holds_alternative<std::string>(v->value) ? std::get<std::string>(v->value) : std::string{};
+        }
+    };
+
+    class JsonParser
+    {
+        std::string_view text;
+        std::size_t pos = 0;
+
+        void skip_whitespace()
+        {
+            while (pos < text.size() && std::isspace((unsigned char)text[pos])) pos++;
+        }
+        bool consume(char c)
+        {
+            skip_whitespace();
+            if (pos < text.size() && text[pos] == c) { pos++; return true; }
+            return false;
+        }
+        bool consume(std::string_view word)
+        {
+            skip_whitespace();
+            if (text.substr(pos, word.size()) != word) return false;
+            pos += word.size();
+            return true;
+        }
+
+        std::optional<std::string> parse_string()
+        {
+            if (!consume('"')) return std::nullopt;
+            std::string result;
+            while (pos < text.size() && text[pos] != '"')
+            {
+                if (text[pos] == '\\' && pos + 1 < text.size()) pos++;
+                result += text[pos++];
+            }
+            if (pos++ >= text.size()) return std::nullopt;
+            return result;
+        }
+
+    public:
+        explicit JsonParser(std::string_view text) : text(text) {}
+
+        std::optional<JsonValue> parse()
+        {
+            skip_whitespace();
+            if (pos >= text.size()) return std::nullopt;
+
+            if (text[pos] == '{')
+            {
+                pos++;
+                JsonValue::Object object;
+                if (consume('}')) return JsonValue{std::move(object)};
+                do
+                {
+                    auto key = parse_string();
+                    if (!key || !consume(':')) return std::nullopt;
+                    auto value = parse();
+                    if (!value) return std::nullopt;
+                    object.emplace_back(std::move(*key), std::move(*value));
+                } while (consume(','));
+                if (!consume('}')) return std::nullopt;
+                return JsonValue{std::move(object)};
+            }
+            if (text[pos] == '[')
+            {
+                pos++;
+                JsonValue::Array array;
+                if (consume(']')) return JsonValue{std::move(array)};
+                do
+                {
+                    auto value = parse();
+                    if (!value) return std::nullopt;
+                    array.push_back(std::move(*value));
+                } while (consume(','));
+                if (!consume(']')) return std::nullopt;
+                return JsonValue{std::move(array)};
+            }
+            if (text[pos] == '"')
+            {
+                auto string = parse_string();
+                if (!string) return std::nullopt;
+                return JsonValue{std::move(*string)};
+            }
+            if (consume("true"))  return JsonValue{true};
+            if (consume("false")) return JsonValue{false};
+            if (consume("null"))  return JsonValue{nullptr};
+
+            std::size_t length = 0;
+            double number;
+            try
+            {
+                number = std::stod(std::string(text.substr(pos, 32)), &length);
+            }
+            catch (std::exception&)
+            {
+                return std::nullopt;
+            }
+            pos += length;
+            return JsonValue{number};
+        }
+    };
+
+    inline std::optional<std::vector<BenchmarkRecord>> read_json(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+            return std::nullopt;
+
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string text = buffer.str();
+
+        auto root = JsonParser(text).parse();
+        if (!root) return std::nullopt;
+        auto results = root->get("results");
+        if (!results || !std::holds_alternative<JsonValue::Array>(results->value)) return std::nullopt;
+
+        std::vector<BenchmarkRecord> records;
+        for (const auto& entry : std::get<JsonValue::Array>(results->value))
+        {
+            BenchmarkRecord r;
+            r.multiplier = entry.string("multiplier");
+            r.name = entry.string("name");
+            r.n = int(entry.number("n"));
+            r.m = int(entry.number("m"));
+            r.p = int(entry.number("p"));
+            r.mode = entry.string("mode");
+            r.threads = int(entry.number("threads", 1));
+            r.stats.median = entry.number("median_s");
+            r.stats.min = entry.number("min_s");
+            r.stats.mean = entry.number("mean_s");
+            r.stats.stddev = entry.number("stddev_s");
+            r.stats.samples = int(entry.number("samples"));
+            r.stats.calls_per_sample = (long long)entry.number("calls_per_sample");
+            r.gops = entry.number("gops");
+            r.gbps = entry.number("gbps");
+            records.push_back(std::move(r));
+        }
+        return records;
+    }
+
+    // Compares every current point with the same point of the baseline. A point regressed when its median is
+    // more than threshold slower and Welch's t statistic of the means is above 3 (about p < 0.01); points with
+    // a single sample on either side have no variance estimate and are judged by the threshold alone.
+    // Returns the number of regressions.
+    inline int compare(const std::vector<BenchmarkRecord>& baseline, const std::vector<BenchmarkRecord>& current, double threshold, std::ostream& out)
+    {
+        std::map<decltype(BenchmarkRecord{}.key()), const BenchmarkRecord*> base;
+        for (const auto& r : baseline)
+            base[r.key()] = &r;
+
+        int regressions = 0;
+        out << "Comparison with baseline:\n";
+        for (const auto& r : current)
+        {
+            auto it = base.find(r.key());
+            if (it == base.end())
+            {
+                out << std::format("{:<24} {:>5}_{}_{} {:<9} x{:<3}: not in baseline\n", r.multiplier, r.n, r.m, r.p, r.mode, r.threads);
+                continue;
+            }
+            const BenchmarkRecord& b = *it->second;
+
+            double change = b.stats.median > 0 ? r.stats.median / b.stats.median - 1 : 0;
+            bool enough_samples = r.stats.samples > 1 && b.stats.samples > 1;
+            double error = std::sqrt(r.stats.stddev * r.stats.stddev / std::max(r.stats.samples, 1) + b.stats.stddev * b.stats.stddev / std::max(b.stats.samples, 1));
+            double t = error > 0 ? (r.stats.mean - b.stats.mean) / error : 0;
+            bool significant = !enough_samples || error == 0 || std::abs(t) > 3;
+
+            std::string status = "ok";
+            if (significant && change > threshold)
+            {
+                status = "REGRESSION";
+                regressions++;
+            }
+            else if (significant && change < -threshold)
+                status = "faster";
+
+            out << std::format("{:<24} {:>5}_{}_{} {:<9} x{:<3}: {:>9} -> {:>9} ({:+6.1f}%, t = {:6.2f}) {}\n",
+                r.multiplier, r.n, r.m, r.p, r.mode, r.threads,
+                format_duration(b.stats.median), format_duration(r.stats.median), change * 100, t, status);
+        }
+        out << std::format("{} regression(s)\n", regressions);
+        return regressions;
+    }
+}
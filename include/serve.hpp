@@ -0,0 +1,439 @@
+#pragma once
+#include <map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sstream>
+#include <format>
+#include <cstdio>
+#include <optional>
+#include <functional>
+#include <condition_variable>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include "MatrixMultiplier.hpp"
+#include "PackedMatrix.hpp"
+#include "matrix_file.hpp"
+#include "executor.hpp"
+
+#ifndef _WIN32
+    #include <signal.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+// A long-lived worker that multiplies a stream of jobs, keeping what one job set up warm for the next ones: the
+// plans (multipliers) of the shapes seen, the mapped input files (and a packed copy of a file used as B more
+// than once) and the worker threads of a MatMulExecutor. Jobs are text lines, words separated by spaces:
+//
+//   mul <id> <A> <B> <C>      C = A * B of matrix files (see matrix_file.hpp), C is replaced once it is done
+//   mul <id> <N>_<M>_<P>      the line is followed by A and B, row-major native ints, no padding
+//   quit                      ends the stream (so does its end)
+//
+// A job's reply is `ok <id> <N>_<M>_<P> <microseconds from reading the job to finishing it>`, followed by C
+// as raw ints for inline jobs, or `error <id> <reason>`. Jobs run concurrently, so replies come in the order
+// the jobs finish, and a client can send the next jobs without waiting for the replies of the previous ones.
+// Only available on POSIX systems.
+class JobServer
+{
+public:
+    using PlanFactory = std::function<MatrixMultiplier(int, int, int)>;
+
+private:
+    struct Operand
+    {
+        std::shared_ptr<const MappedMatrix> matrix;
+        std::shared_ptr<const PackedMatrix> packed;
+        std::int64_t modified = 0; // nanoseconds, with size to notice the file changed
+        std::int64_t size = 0;
+        int uses = 0;
+
+        std::size_t bytes() const
+        {
+            return (matrix ? matrix->data().size_bytes() : 0) + (packed ? std::size_t(packed->row_count()) * packed->col_count() * sizeof(int) : 0);
+        }
+    };
+
+    static constexpr std::size_t max_plans = 256;
+
+    PlanFactory make_plan;
+    std::size_t cache_bytes;
+    std::mutex mutex;
+    std::map<std::array<int, 3>, std::shared_ptr<const MatrixMultiplier>> plans;
+    std::list<std::pair<std::string, Operand>> operands; // most recently used first
+    MatMulExecutor executor;
+    std::atomic<std::uint64_t> temporaries = 0; // temporary C files named so far
+
+    std::shared_ptr<const MatrixMultiplier> plan(int N, int M, int P)
+    {
+        std::lock_guard lock(mutex);
+        auto& entry = plans[{N, M, P}];
+        if (!entry)
+        {
+            if (plans.size() > max_plans)
+                plans.erase(plans.begin() == plans.find({N, M, P}) ? std::next(plans.begin()) : plans.begin());
+            entry = std::make_shared<const MatrixMultiplier>(make_plan(N, M, P));
+        }
+        return entry;
+    }
+
+#ifndef _WIN32
+    // The mapped file at path, mapped again if it changed since, and packed when it's a B for the second time.
+    // Running jobs keep what they use even if it is evicted meanwhile.
+    std::optional<Operand> operand(const std::string& path, bool as_B)
+    {
+        struct stat status;
+        if (stat(path.c_str(), &status) != 0)
+            return std::nullopt;
+        std::int64_t modified = std::int64_t(status.st_mtim.tv_sec) * 1'000'000'000 + status.st_mtim.tv_nsec;
+
+        std::unique_lock lock(mutex);
+        auto it = std::ranges::find(operands, path, [](const auto& entry){ return entry.first; });
+        if (it == operands.end() || it->second.modified != modified || it->second.size != std::int64_t(status.st_size))
+        {
+            if (it != operands.end()) operands.erase(it);
+            lock.unlock();
+            auto matrix = MappedMatrix::open(path);
+            if (!matrix)
+                return std::nullopt;
+            lock.lock();
+            // Another job may have opened it meanwhile
+            it = std::ranges::find(operands, path, [](const auto& entry){ return entry.first; });
+            if (it != operands.end() && it->second.modified == modified && it->second.size == std::int64_t(status.st_size))
+                operands.splice(operands.begin(), operands, it);
+            else
+            {
+                if (it != operands.end()) operands.erase(it);
+                operands.emplace_front(path, Operand{std::make_shared<const MappedMatrix>(std::move(*matrix)), nullptr, modified, std::int64_t(status.st_size), 0});
+            }
+        }
+        else
+            operands.splice(operands.begin(), operands, it);
+
+        Operand& entry = operands.front().second;
+        if (as_B && ++entry.uses >= 2 && !entry.packed)
+        {
+            auto matrix = entry.matrix;
+            lock.unlock();
+            auto packed = std::make_shared<const PackedMatrix>(matrix->view());
+            lock.lock();
+            auto again = std::ranges::find(operands, path, [](const auto& entry){ return entry.first; });
+            if (again != operands.end() && again->second.matrix == matrix)
+                again->second.packed = packed;
+            Operand result{matrix, packed, modified, std::int64_t(status.st_size), 0};
+            evict();
+            return result;
+        }
+        Operand result = entry;
+        evict();
+        return result;
+    }
+
+    // Least recently used files out while over cache_bytes, never the one just used
+    void evict()
+    {
+        std::size_t total = 0;
+        for (const auto& [path, entry] : operands) total += entry.bytes();
+        while (operands.size() > 1 && total > cache_bytes)
+        {
+            total -= operands.back().second.bytes();
+            operands.pop_back();
+        }
+    }
+
+    // Reads lines and exact byte counts from a file descriptor through a buffer
+    class Reader
+    {
+        int fd;
+        std::vector<char> buffer;
+        std::size_t begin = 0, end = 0;
+
+        bool fill()
+        {
+            if (begin == end) begin = end = 0;
+            if (end == buffer.size())
+            {
+                std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+                if (end == buffer.size()) buffer.resize(buffer.size() * 2);
+            }
+            ssize_t count = ::read(fd, buffer.data() + end, buffer.size() - end);
+            if (count <= 0)
+                return false;
+            end += std::size_t(count);
+            return true;
+        }
+
+    public:
+        explicit Reader(int fd) : fd(fd), buffer(1 << 16) {}
+
+        std::optional<std::string> line()
+        {
+            std::size_t scanned = 0; // from begin, which fill may move
+            while (true)
+            {
+                char* found = static_cast<char*>(std::memchr(buffer.data() + begin + scanned, '\n', end - begin - scanned));
+                if (found)
+                {
+                    std::string result(buffer.data() + begin, found);
+                    begin = std::size_t(found - buffer.data()) + 1;
+                    if (!result.empty() && result.back() == '\r') result.pop_back();
+                    return result;
+                }
+                scanned = end - begin;
+                if (!fill())
+                    return std::nullopt;
+            }
+        }
+
+        bool bytes(void* to, std::size_t size)
+        {
+            auto out = static_cast<char*>(to);
+            while (size > 0)
+            {
+                if (begin == end && !fill())
+                    return false;
+                std::size_t count = std::min(size, end - begin);
+                std::memcpy(out, buffer.data() + begin, count);
+                begin += count;
+                out += count;
+                size -= count;
+            }
+            return true;
+        }
+    };
+
+    // Replies of the jobs of one stream, written whole by one job at a time. Counts the jobs still running,
+    // the stream is only closed after all of them replied.
+    struct Stream
+    {
+        int fd;
+        std::mutex mutex;
+        std::condition_variable finished;
+        int running = 0;
+
+        void reply(const std::string& line, std::span<const int> data = {})
+        {
+            std::lock_guard lock(mutex);
+            bool ok = write_all(line.data(), line.size());
+            if (ok && !data.empty())
+                write_all(data.data(), data.size_bytes());
+        }
+
+        bool write_all(const void* from, std::size_t size)
+        {
+            auto bytes = static_cast<const char*>(from);
+            while (size > 0)
+            {
+                ssize_t count = ::write(fd, bytes, size);
+                if (count <= 0)
+                    return false;
+                bytes += count;
+                size -= std::size_t(count);
+            }
+            return true;
+        }
+    };
+
+    static std::optional<std::array<int, 3>> parse_shape(const std::string& text)
+    {
+        std::array<long long, 3> size{};
+        char extra;
+        if (std::sscanf(text.c_str(), "%lld_%lld_%lld%c", &size[0], &size[1], &size[2], &extra) != 3)
+            return std::nullopt;
+        for (long long value : size)
+            if (value < 1 || value > INT_MAX) return std::nullopt;
+        if (size[0] * size[1] > INT_MAX || size[1] * size[2] > INT_MAX || size[0] * size[2] > INT_MAX)
+            return std::nullopt;
+        return std::array{int(size[0]), int(size[1]), int(size[2])};
+    }
+
+    // Queues one job, returns false if the stream can't be read any further
+    bool queue_job(const std::string& line, Reader& reader, const std::shared_ptr<Stream>& stream)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::istringstream words(line);
+        std::string verb, id;
+        std::vector<std::string> args;
+        words >> verb >> id;
+        for (std::string word; words >> word;) args.push_back(word);
+
+        auto error = [&](std::string_view reason) { stream->reply(std::format("error {} {}\n", id.empty() ? "-" : id, reason)); };
+        if (verb != "mul" || id.empty() || (args.size() != 1 && args.size() != 3))
+        {
+            error("expected: mul <id> <A> <B> <C> | mul <id> <N>_<M>_<P>");
+            return true;
+        }
+
+        // What a job holds on to until it is done
+        struct Job
+        {
+            std::shared_ptr<const MatrixMultiplier> plan;
+            std::optional<Operand> A, B;
+            std::vector<int> A_data, B_data, C_data;
+            std::optional<MappedMatrix> C_file;
+            std::string C_path, C_temporary;
+            std::array<int, 3> size;
+        };
+        auto job = std::make_shared<Job>();
+        MatrixView A, B, C;
+
+        if (args.size() == 1)
+        {
+            auto size = parse_shape(args[0]);
+            if (!size)
+            {
+                error("invalid shape, the rest of the stream can't be read");
+                return false;
+            }
+            auto [N, M, P] = job->size = *size;
+            job->A_data.resize(std::size_t(N) * M);
+            job->B_data.resize(std::size_t(M) * P);
+            job->C_data.resize(std::size_t(N) * P);
+            if (!reader.bytes(job->A_data.data(), job->A_data.size() * sizeof(int)) || !reader.bytes(job->B_data.data(), job->B_data.size() * sizeof(int)))
+                return false;
+            A = MatrixView(job->A_data, M);
+            B = MatrixView(job->B_data, P);
+            C = MatrixView(job->C_data, P);
+        }
+        else
+        {
+            job->A = operand(args[0], false);
+            job->B = operand(args[1], true);
+            if (!job->A || !job->B)
+            {
+                error(std::format("can't read matrix {}", job->A ? args[1] : args[0]));
+                return true;
+            }
+            auto& a = *job->A->matrix;
+            auto& b = *job->B->matrix;
+            if (a.col_count() != b.row_count())
+            {
+                error(std::format("can't multiply a {}x{} matrix with a {}x{} one", a.row_count(), a.col_count(), b.row_count(), b.col_count()));
+                return true;
+            }
+            job->size = {a.row_count(), a.col_count(), b.col_count()};
+
+            // Written next to C and renamed over it when done, so jobs still reading an older C are unaffected.
+            // Named by the server (never by the client's id) so concurrent jobs writing the same C don't collide.
+            job->C_path = args[2];
+            job->C_temporary = std::format("{}.{}.{}", args[2], getpid(), temporaries++);
+            job->C_file = MappedMatrix::create(job->C_temporary, a.row_count(), b.col_count());
+            if (!job->C_file)
+            {
+                error(std::format("can't write matrix {}", args[2]));
+                return true;
+            }
+            A = a.view();
+            B = b.view();
+            C = job->C_file->view();
+        }
+        job->plan = plan(job->size[0], job->size[1], job->size[2]);
+
+        {
+            std::lock_guard lock(stream->mutex);
+            stream->running++;
+        }
+        auto done = [job, stream, id, start](std::exception_ptr exception)
+        {
+            auto [N, M, P] = job->size;
+            bool ok = !exception;
+            if (job->C_file)
+            {
+                job->C_file->flush();
+                ok = ok && std::rename(job->C_temporary.c_str(), job->C_path.c_str()) == 0;
+                if (!ok) std::remove(job->C_temporary.c_str());
+            }
+            auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            if (!ok)                         stream->reply(std::format("error {} {}\n", id, exception ? "multiplication failed" : "can't write the result"));
+            else if (job->C_file)            stream->reply(std::format("ok {} {}_{}_{} {}\n", id, N, M, P, microseconds));
+            else                             stream->reply(std::format("ok {} {}_{}_{} {}\n", id, N, M, P, microseconds), job->C_data);
+
+            std::lock_guard lock(stream->mutex);
+            if (--stream->running == 0)
+                stream->finished.notify_all();
+        };
+
+        if (job->B && job->B->packed) executor.submit(*job->plan, A, *job->B->packed, C, MatMulMode::Overwrite, done);
+        else                          executor.submit(*job->plan, A, B, C, MatMulMode::Overwrite, done);
+        return true;
+    }
+#endif
+
+public:
+    // make_plan builds the multiplier of a shape, once. The thread_count workers of the executor run jobs
+    // concurrently, so plans should be single-threaded. cache_bytes bounds the mapped and packed input files
+    // kept between jobs.
+    JobServer(PlanFactory make_plan, int thread_count, std::size_t cache_bytes)
+        : make_plan(std::move(make_plan)), cache_bytes(cache_bytes), executor(thread_count)
+    {
+    }
+
+    // Serves the jobs read from in and writes their replies to out until the end of the input or quit, then
+    // waits for the jobs still running
+    void serve(int in, int out)
+    {
+#ifndef _WIN32
+        signal(SIGPIPE, SIG_IGN); // a client that went away fails the writes instead
+        Reader reader(in);
+        auto stream = std::make_shared<Stream>();
+        stream->fd = out;
+        while (auto line = reader.line())
+        {
+            if (line->empty())
+                continue;
+            if (*line == "quit" || !queue_job(*line, reader, stream))
+                break;
+        }
+        std::unique_lock lock(stream->mutex);
+        stream->finished.wait(lock, [&] { return stream->running == 0; });
+#endif
+    }
+
+    // Serves every connection of a Unix socket at path on a thread of its own, until the process ends. Returns
+    // false if it can't listen.
+    bool listen(const std::string& path)
+    {
+#ifndef _WIN32
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path))
+            return false;
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+            return false;
+        ::unlink(path.c_str());
+        if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, 16) != 0)
+        {
+            ::close(listener);
+            return false;
+        }
+
+        while (true)
+        {
+            int connection = accept(listener, nullptr, nullptr);
+            if (connection < 0)
+                continue;
+            std::thread([this, connection]
+            {
+                serve(connection, connection);
+                ::close(connection);
+            }).detach();
+        }
+#else
+        return false;
+#endif
+    }
+};
@@ -0,0 +1,155 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <shared_mutex>
+#include <mutex>
+#include <algorithm>
+#include "MatrixView.hpp"
+
+// Block sparsity of operands that are mostly zero in large regions. sparsity::Index builds a map of the tiles
+// of an operand that hold a non-zero, once, and registers it while it lives. The strategies that split a
+// multiplication (blocked, recursive, multithreaded) look up the parts they make in it, skip the products
+// with a part that has no non-zero tile, and balance threads on the remaining work. Views of operands that
+// aren't indexed count as dense. An indexed operand must not change while its Index lives.
+namespace sparsity
+{
+    inline constexpr int default_tile_size = 32;
+
+    // Which tiles of one operand hold a non-zero, as 2D prefix counts so any range of tiles is counted in O(1)
+    class TileMap
+    {
+        const int* buffer;
+        int row_size, row_start, col_start, rows, cols;
+        int tile_size, tile_rows, tile_cols;
+        std::vector<int> nonzero_before; // (tile_rows + 1) x (tile_cols + 1), non-zero tiles above and left of each
+
+        int count(int r0, int c0, int r1, int c1) const
+        {
+            auto at = [&](int r, int c) { return nonzero_before[std::size_t(r) * (tile_cols + 1) + c]; };
+            return at(r1, c1) - at(r0, c1) - at(r1, c0) + at(r0, c0);
+        }
+
+    public:
+        TileMap(MatrixView view, int tile_size)
+            : buffer(view.buffer()), row_size(view.buffer_row_size()), row_start(view.first_row()), col_start(view.first_col()),
+              rows(view.row_count()), cols(view.col_count()), tile_size(std::max(tile_size, 1)),
+              tile_rows((rows + this->tile_size - 1) / this->tile_size), tile_cols((cols + this->tile_size - 1) / this->tile_size),
+              nonzero_before(std::size_t(tile_rows + 1) * (tile_cols + 1), 0)
+        {
+            std::vector<char> nonzero(std::size_t(tile_rows) * tile_cols, 0);
+            for (int r = 0; r < rows; r++)
+            {
+                const int* row = buffer + std::size_t(row_size) * (row_start + r) + col_start;
+                for (int c = 0; c < cols; c++)
+                    if (row[c] != 0)
+                        nonzero[std::size_t(r / this->tile_size) * tile_cols + c / this->tile_size] = 1;
+            }
+
+            for (int r = 0; r < tile_rows; r++)
+                for (int c = 0; c < tile_cols; c++)
+                    nonzero_before[std::size_t(r + 1) * (tile_cols + 1) + c + 1] = nonzero[std::size_t(r) * tile_cols + c]
+                        + nonzero_before[std::size_t(r) * (tile_cols + 1) + c + 1]
+                        + nonzero_before[std::size_t(r + 1) * (tile_cols + 1) + c]
+                        - nonzero_before[std::size_t(r) * (tile_cols + 1) + c];
+        }
+
+        const int* data() const { return buffer; }
+
+        bool covers(MatrixView view) const
+        {
+            return view.buffer() == buffer && view.buffer_row_size() == row_size &&
+                   view.first_row() >= row_start && view.first_row() + view.row_count() <= row_start + rows &&
+                   view.first_col() >= col_start && view.first_col() + view.col_count() <= col_start + cols;
+        }
+
+        // Fraction of the tiles overlapping view (which it covers) that hold a non-zero, 0 for empty views
+        double density(MatrixView view) const
+        {
+            if (view.row_count() == 0 || view.col_count() == 0)
+                return 0;
+            int r0 = (view.first_row() - row_start) / tile_size, r1 = (view.first_row() - row_start + view.row_count() - 1) / tile_size + 1;
+            int c0 = (view.first_col() - col_start) / tile_size, c1 = (view.first_col() - col_start + view.col_count() - 1) / tile_size + 1;
+            return double(count(r0, c0, r1, c1)) / (double(r1 - r0) * (c1 - c0));
+        }
+
+        double density() const
+        {
+            return tile_rows && tile_cols ? double(count(0, 0, tile_rows, tile_cols)) / (double(tile_rows) * tile_cols) : 0;
+        }
+    };
+
+    namespace detail
+    {
+        inline std::shared_mutex registry_mutex;
+        inline std::multimap<const int*, const TileMap*> registry; // by buffer
+        inline std::atomic<int> registered = 0;                   // so lookups without any index take no lock
+    }
+
+    // Fraction of the tiles of view that hold a non-zero, by the index of the operand it is part of, 1 if there is none
+    inline double density(MatrixView view)
+    {
+        if (detail::registered.load(std::memory_order_relaxed) == 0)
+            return 1;
+
+        std::shared_lock lock(detail::registry_mutex);
+        auto [begin, end] = detail::registry.equal_range(view.buffer());
+        for (auto it = begin; it != end; it++)
+            if (it->second->covers(view))
+                return it->second->density(view);
+        return 1;
+    }
+
+    // Whether multiplying with view can be skipped: it is empty or an index knows it has only zero tiles
+    inline bool is_zero(MatrixView view)
+    {
+        return view.row_count() == 0 || view.col_count() == 0 || density(view) == 0;
+    }
+
+    // The tile map of an operand, seen by the strategies from construction to destruction
+    class Index
+    {
+        std::unique_ptr<TileMap> map;
+
+        void unregister()
+        {
+            if (!map)
+                return;
+            std::unique_lock lock(detail::registry_mutex);
+            auto [begin, end] = detail::registry.equal_range(map->data());
+            for (auto it = begin; it != end; it++)
+                if (it->second == map.get())
+                {
+                    detail::registry.erase(it);
+                    detail::registered--;
+                    break;
+                }
+        }
+
+    public:
+        Index() = default;
+        explicit Index(MatrixView operand, int tile_size = default_tile_size)
+            : map(std::make_unique<TileMap>(operand, tile_size))
+        {
+            std::unique_lock lock(detail::registry_mutex);
+            detail::registry.emplace(map->data(), map.get());
+            detail::registered++;
+        }
+
+        Index(Index&&) = default;
+        Index& operator=(Index&& other)
+        {
+            if (this != &other)
+            {
+                unregister();
+                map = std::move(other.map);
+            }
+            return *this;
+        }
+        ~Index() { unregister(); }
+
+        // Of the whole operand, 0 if there is none
+        double density() const { return map ? map->density() : 0; }
+    };
+}
@@ -0,0 +1,254 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include <cstddef>
+
+#ifdef MATMUL_TRACE
+    #include <map>
+    #include <array>
+    #include <mutex>
+    #include <atomic>
+    #include <chrono>
+    #include <format>
+    #include <algorithm>
+    #include "benchmark.hpp"
+#endif
+
+// Opt-in instrumentation of MatrixMultiplier's strategy chains, compiled in with MATMUL_TRACE (the CMake
+// option of the same name). Every strategy a chain dispatches to becomes a node of a call tree keyed by the
+// strategies above it, with its call count, shapes, inclusive and exclusive time and the scratch memory it
+// allocated. Without MATMUL_TRACE all of it is empty inline functions.
+namespace trace
+{
+#ifdef MATMUL_TRACE
+    inline constexpr bool enabled = true;
+
+    struct Node
+    {
+        std::string name;
+        int parent = -1;
+        int depth = 0;
+        std::map<std::string, int, std::less<>> children;
+        long long calls = 0;
+        double inclusive = 0;          // seconds, summed over all threads
+        double exclusive = 0;          // inclusive minus the children that ran on the same thread
+        std::size_t scratch_bytes = 0;
+        std::map<std::array<int, 3>, long long> shapes;
+    };
+
+    // A copy of the call tree, node 0 is the root every thread starts from
+    struct Profile
+    {
+        std::vector<Node> nodes;
+
+        bool empty() const { return nodes.size() <= 1; }
+
+        std::string path(int node) const
+        {
+            std::string result;
+            for (; node > 0; node = nodes[node].parent)
+                result = nodes[node].name + (result.empty() ? "" : ";") + result;
+            return result;
+        }
+
+        // "prefix;strategy;strategy... <exclusive nanoseconds>" lines, the input of flamegraph.pl and speedscope
+        void write_folded(std::ostream& out, std::string_view prefix) const
+        {
+            for (int i = 1; i < int(nodes.size()); i++)
+                if (long long ns = (long long)(nodes[i].exclusive * 1e9); ns > 0)
+                    out << prefix << ';' << path(i) << ' ' << ns << '\n';
+        }
+
+        // One line per (depth, strategy), with the most frequent shapes
+        void print_summary(std::ostream& out, std::string_view indent) const
+        {
+            struct Level
+            {
+                long long calls = 0;
+                double inclusive = 0, exclusive = 0;
+                std::size_t scratch_bytes = 0;
+                std::map<std::array<int, 3>, long long> shapes;
+            };
+            std::map<std::pair<int, std::string>, Level> levels;
+            for (int i = 1; i < int(nodes.size()); i++)
+            {
+                Level& level = levels[{nodes[i].depth, nodes[i].name}];
+                level.calls += nodes[i].calls;
+                level.inclusive += nodes[i].inclusive;
+                level.exclusive += nodes[i].exclusive;
+                level.scratch_bytes += nodes[i].scratch_bytes;
+                for (auto& [shape, count] : nodes[i].shapes)
+                    level.shapes[shape] += count;
+            }
+
+            out << std::format("{}{:>5} {:<14} {:>9} {:>10} {:>10} {:>10}  shapes\n", indent, "depth", "strategy", "calls", "inclusive", "exclusive", "scratch");
+            for (auto& [key, level] : levels)
+            {
+                std::vector<std::pair<long long, std::array<int, 3>>> shapes;
+                for (auto& [shape, count] : level.shapes)
+                    shapes.emplace_back(count, shape);
+                std::ranges::sort(shapes, std::greater{});
+
+                std::string shape_text;
+                for (std::size_t i = 0; i < std::min<std::size_t>(shapes.size(), 3); i++)
+                    shape_text += std::format("{}{}_{}_{} x{}", i ? ", " : "", shapes[i].second[0], shapes[i].second[1], shapes[i].second[2], shapes[i].first);
+                if (shapes.size() > 3)
+                    shape_text += std::format(", +{} more", shapes.size() - 3);
+
+                out << std::format("{}{:>5} {:<14} {:>9} {:>10} {:>10} {:>9}K  {}\n", indent, key.first, key.second, level.calls,
+                    format_duration(level.inclusive), format_duration(level.exclusive), (level.scratch_bytes + 1023) / 1024, shape_text);
+            }
+        }
+    };
+
+    namespace detail
+    {
+        struct State
+        {
+            std::mutex mutex;
+            std::vector<Node> nodes{Node{}};
+            std::atomic<bool> recording = false;
+        };
+
+        inline State& state()
+        {
+            static State s;
+            return s;
+        }
+
+        inline thread_local int current = 0; // node of the innermost scope of this thread
+    }
+
+    // Records one dispatch to the strategy `name`, as a child of the current node of this thread
+    class Scope
+    {
+        Scope* outer = nullptr;
+        int parent = 0;
+        int node = -1;
+        double child_time = 0;
+        std::chrono::steady_clock::time_point start;
+
+        inline static thread_local Scope* innermost = nullptr;
+
+    public:
+        Scope(std::string_view name, int n, int m, int p)
+        {
+            auto& state = detail::state();
+            if (!state.recording.load(std::memory_order_relaxed))
+                return;
+
+            parent = detail::current;
+            {
+                std::lock_guard lock(state.mutex);
+                auto it = state.nodes[parent].children.find(name);
+                if (it != state.nodes[parent].children.end())
+                    node = it->second;
+                else
+                {
+                    node = int(state.nodes.size());
+                    state.nodes[parent].children.emplace(std::string(name), node);
+                    state.nodes.push_back(Node{std::string(name), parent, state.nodes[parent].depth + 1});
+                }
+                state.nodes[node].calls++;
+                state.nodes[node].shapes[{n, m, p}]++;
+            }
+
+            outer = innermost;
+            innermost = this;
+            detail::current = node;
+            start = std::chrono::steady_clock::now();
+        }
+
+        ~Scope()
+        {
+            if (node < 0)
+                return;
+
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            innermost = outer;
+            detail::current = parent;
+            if (outer)
+                outer->child_time += elapsed;
+
+            auto& state = detail::state();
+            std::lock_guard lock(state.mutex);
+            state.nodes[node].inclusive += elapsed;
+            state.nodes[node].exclusive += elapsed - child_time;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // Node to hand to the threads a strategy starts, so their dispatches are recorded below it
+    inline int current_node() { return detail::current; }
+
+    // Makes the dispatches of a new thread children of parent (from current_node() of the starting thread)
+    class Adopt
+    {
+        int previous;
+
+    public:
+        explicit Adopt(int parent) : previous(detail::current) { detail::current = parent; }
+        ~Adopt() { detail::current = previous; }
+
+        Adopt(const Adopt&) = delete;
+        Adopt& operator=(const Adopt&) = delete;
+    };
+
+    // Scratch memory allocated by the strategy currently running on this thread
+    inline void scratch(std::size_t bytes)
+    {
+        auto& state = detail::state();
+        if (!state.recording.load(std::memory_order_relaxed) || detail::current == 0)
+            return;
+
+        std::lock_guard lock(state.mutex);
+        state.nodes[detail::current].scratch_bytes += bytes;
+    }
+
+    // Clears the tree and starts recording
+    inline void start()
+    {
+        auto& state = detail::state();
+        std::lock_guard lock(state.mutex);
+        state.nodes.assign(1, Node{});
+        state.recording = true;
+    }
+
+    inline Profile stop()
+    {
+        auto& state = detail::state();
+        std::lock_guard lock(state.mutex);
+        state.recording = false;
+        return Profile{state.nodes};
+    }
+#else
+    inline constexpr bool enabled = false;
+
+    struct Profile
+    {
+        bool empty() const { return true; }
+        void write_folded(std::ostream&, std::string_view) const {}
+        void print_summary(std::ostream&, std::string_view) const {}
+    };
+
+    struct Scope
+    {
+        Scope(std::string_view, int, int, int) {}
+    };
+
+    inline int current_node() { return 0; }
+
+    struct Adopt
+    {
+        explicit Adopt(int) {}
+    };
+
+    inline void scratch(std::size_t) {}
+    inline void start() {}
+    inline Profile stop() { return {}; }
+#endif
+}
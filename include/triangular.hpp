@@ -0,0 +1,171 @@
+#pragma once
+#include <span>
+#include <array>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include "MatrixView.hpp"
+
+enum class Triangle
+{
+    Lower,
+    Upper
+};
+
+namespace detail
+{
+    // Diagonal blocks up to this size are multiplied in full, only their triangle is used
+    constexpr int triangle_base_size = 32;
+
+    inline bool in_triangle(Triangle triangle, int i, int j)
+    {
+        return triangle == Triangle::Lower ? j <= i : j >= i;
+    }
+
+    // The triangle of the square C = A * At, halving it into two smaller triangles and one full block
+    template<class F>
+    void syrk_diagonal(F& multiplier, MatrixView A, MatrixView At, MatrixView C, MatMulMode mode, Triangle triangle, std::vector<int>& scratch)
+    {
+        int n = C.row_count(), k = A.col_count();
+        if (n <= triangle_base_size)
+        {
+            scratch.resize(std::size_t(n) * n);
+            MatrixView full(std::span<int>(scratch), n, 0, n, 0, n);
+            multiplier(A, At, full, MatMulMode::Overwrite);
+            for (int i = 0; i < n; i++)
+                for (int j = 0; j < n; j++)
+                    if (in_triangle(triangle, i, j))
+                        C(i, j) = mode == MatMulMode::Overwrite ? full(i, j) : int(std::uint32_t(C(i, j)) + std::uint32_t(full(i, j)));
+            return;
+        }
+
+        int h = n / 2;
+        syrk_diagonal(multiplier, A.getSubMatrix(0, h, 0, k), At.getSubMatrix(0, k, 0, h), C.getSubMatrix(0, h, 0, h), mode, triangle, scratch);
+        syrk_diagonal(multiplier, A.getSubMatrix(h, n, 0, k), At.getSubMatrix(0, k, h, n), C.getSubMatrix(h, n, h, n), mode, triangle, scratch);
+        if (triangle == Triangle::Lower) multiplier(A.getSubMatrix(h, n, 0, k), At.getSubMatrix(0, k, 0, h), C.getSubMatrix(h, n, 0, h), mode);
+        else                             multiplier(A.getSubMatrix(0, h, 0, k), At.getSubMatrix(0, k, h, n), C.getSubMatrix(0, h, h, n), mode);
+    }
+
+    // C = T * B for the square triangular T: the two triangles of the halves of T recursively, the full block
+    // between them with multiplier
+    template<class F>
+    void trmm_recursive(F& multiplier, Triangle triangle, MatrixView T, MatrixView B, MatrixView C, MatMulMode mode, std::vector<int>& scratch)
+    {
+        int n = T.row_count(), p = B.col_count();
+        if (n <= triangle_base_size)
+        {
+            scratch.resize(std::size_t(n) * n);
+            MatrixView masked(std::span<int>(scratch), n, 0, n, 0, n);
+            for (int i = 0; i < n; i++)
+                for (int j = 0; j < n; j++)
+                    masked(i, j) = in_triangle(triangle, i, j) ? T(i, j) : 0;
+            multiplier(masked, B, C, mode);
+            return;
+        }
+
+        int h = n / 2;
+        MatrixView B1 = B.getSubMatrix(0, h, 0, p), B2 = B.getSubMatrix(h, n, 0, p);
+        MatrixView C1 = C.getSubMatrix(0, h, 0, p), C2 = C.getSubMatrix(h, n, 0, p);
+        trmm_recursive(multiplier, triangle, T.getSubMatrix(0, h, 0, h), B1, C1, mode, scratch);
+        if (triangle == Triangle::Lower)
+        {
+            multiplier(T.getSubMatrix(h, n, 0, h), B1, C2, mode);
+            trmm_recursive(multiplier, triangle, T.getSubMatrix(h, n, h, n), B2, C2, MatMulMode::Add, scratch);
+        }
+        else
+        {
+            multiplier(T.getSubMatrix(0, h, h, n), B2, C1, MatMulMode::Add);
+            trmm_recursive(multiplier, triangle, T.getSubMatrix(h, n, h, n), B2, C2, mode, scratch);
+        }
+    }
+}
+
+// SYRK: the given triangle of the n x n C = A * A^T (or C += A * A^T) for the n x k A, the other triangle is
+// left as it is. The triangle is split into blocks that multiplier (e.g. a single-threaded MatrixMultiplier)
+// multiplies in full, except the diagonal ones, which are halved recursively so almost no work is wasted above
+// or below the diagonal. The blocks are divided between thread_count threads in contiguous runs of equal
+// work (a diagonal block counts half). A^T is copied once, O(n * k).
+template<class F>
+void syrk(F multiplier, MatrixView A, MatrixView C, MatMulMode mode, Triangle triangle = Triangle::Lower, int thread_count = 1)
+{
+    int n = A.row_count(), k = A.col_count();
+    if (C.row_count() != n || C.col_count() != n || n == 0)
+        return;
+
+    std::vector<int> transposed(std::size_t(k) * n);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < k; j++)
+            transposed[std::size_t(j) * n + i] = A(i, j);
+    MatrixView At(std::span<int>(transposed), n, 0, k, 0, n);
+
+    // Blocks at least 64 wide, and at least 8 of them per dimension when the matrix is big enough to balance
+    int block = std::max(64, (n + 7) / 8);
+    int blocks = (n + block - 1) / block;
+    std::vector<std::array<int, 2>> tasks;
+    std::vector<double> work{0}; // before each task, then the total
+    for (int I = 0; I < blocks; I++)
+        for (int J = 0; J < blocks; J++)
+            if (detail::in_triangle(triangle, I, J))
+            {
+                double rows = std::min(block, n - I * block), cols = std::min(block, n - J * block);
+                tasks.push_back({I, J});
+                work.push_back(work.back() + rows * cols * (I == J ? 0.5 : 1));
+            }
+
+    auto run = [&](std::size_t begin, std::size_t end)
+    {
+        std::vector<int> scratch;
+        for (std::size_t t = begin; t < end; t++)
+        {
+            auto [I, J] = tasks[t];
+            int i = I * block, j = J * block, i_end = std::min(n, i + block), j_end = std::min(n, j + block);
+            MatrixView A_rows = A.getSubMatrix(i, i_end, 0, k);
+            MatrixView At_cols = At.getSubMatrix(0, k, j, j_end);
+            MatrixView C_block = C.getSubMatrix(i, i_end, j, j_end);
+            if (I == J) detail::syrk_diagonal(multiplier, A_rows, At_cols, C_block, mode, triangle, scratch);
+            else        multiplier(A_rows, At_cols, C_block, mode);
+        }
+    };
+
+    // Thread t takes the tasks whose work starts in [total * t / threads, total * (t + 1) / threads)
+    int threads = std::clamp(thread_count, 1, int(tasks.size()));
+    auto first_task = [&](int t)
+    {
+        return std::size_t(std::ranges::lower_bound(work.begin(), work.end() - 1, work.back() * t / threads) - work.begin());
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(run, first_task(t), first_task(t + 1));
+    run(0, first_task(1));
+    for (auto& worker : workers) worker.join();
+}
+
+// TRMM: C = T * B (or C += T * B) where only the given triangle of the square T is read, the rest counts as
+// zero. The triangle is halved recursively into full blocks for multiplier, doing about half the work of a
+// general multiplication. Every column of B costs the same, so thread_count threads each take an equal
+// range of the columns of B and C.
+template<class F>
+void trmm(F multiplier, Triangle triangle, MatrixView T, MatrixView B, MatrixView C, MatMulMode mode, int thread_count = 1)
+{
+    int n = T.row_count(), p = B.col_count();
+    if (T.col_count() != n || B.row_count() != n || C.row_count() != n || C.col_count() != p)
+        return;
+    if (n == 0)
+        return;
+
+    constexpr int min_columns_per_thread = 16;
+    int threads = std::clamp(p / min_columns_per_thread, 1, std::max(thread_count, 1));
+    auto run = [&](int begin, int end)
+    {
+        std::vector<int> scratch;
+        if (begin < end)
+            detail::trmm_recursive(multiplier, triangle, T, B.getSubMatrix(0, n, begin, end), C.getSubMatrix(0, n, begin, end), mode, scratch);
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(run, int(std::int64_t(p) * t / threads), int(std::int64_t(p) * (t + 1) / threads));
+    run(0, p / threads);
+    for (auto& worker : workers) worker.join();
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <vector>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include "MatrixView.hpp"
+#include "modular.hpp"
+
+enum class VerifyMethod
+{
+    Freivalds, // randomized, in the same wrapping 32 bit arithmetic as the multiplication
+    Modular,   // randomized, modulo a 31 bit prime
+    Full       // compared with a reference multiplication
+};
+
+namespace detail
+{
+    // A product with an empty inner dimension is all zeros
+    inline bool empty_product_check(MatrixView C)
+    {
+        for (int i = 0; i < C.row_count(); i++)
+            for (int j = 0; j < C.col_count(); j++)
+                if (C(i, j) != 0)
+                    return false;
+        return true;
+    }
+}
+
+// Checks C == scale * A * B with Freivalds' algorithm: C * r == scale * A * (B * r) for `rounds` random
+// vectors r, in unsigned 32 bit arithmetic, which wraps exactly like the int arithmetic of the multiplication.
+// Each round costs three matrix-vector products. A wrong C passes a round with probability at most 1/2
+// (when every wrong entry is off by a multiple of 2^31), usually about 2^-32.
+bool freivaldsCheck(MatrixView A, MatrixView B, MatrixView C, int scale = 1, int rounds = 8,
+                    std::uint64_t seed = std::random_device{}(), int thread_count = std::thread::hardware_concurrency())
+{
+    if (A.col_count() != B.row_count() || B.col_count() != C.col_count() || A.row_count() != C.row_count())
+        return false;
+
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+    if (n == 0 || m == 0 || p == 0)
+        return detail::empty_product_check(C);
+
+    std::mt19937_64 rng(seed);
+    std::vector<std::uint32_t> r(p), y(m);
+    std::atomic<bool> equal = true;
+
+    for (int round = 0; round < rounds && equal; round++)
+    {
+        for (auto& value : r) value = std::uint32_t(rng());
+
+        detail::parallel_rows(m, thread_count, [&](int begin, int end)
+        {
+            for (int k = begin; k < end; k++)
+            {
+                const int* b = B.pointer(k, 0);
+                std::uint32_t sum = 0;
+                for (int j = 0; j < p; j++)
+                    sum += std::uint32_t(b[j]) * r[j];
+                y[k] = sum;
+            }
+        });
+
+        detail::parallel_rows(n, thread_count, [&](int begin, int end)
+        {
+            for (int i = begin; i < end && equal.load(std::memory_order_relaxed); i++)
+            {
+                const int* a = A.pointer(i, 0);
+                const int* c = C.pointer(i, 0);
+                std::uint32_t ab = 0, cr = 0;
+                for (int k = 0; k < m; k++)
+                    ab += std::uint32_t(a[k]) * y[k];
+                for (int j = 0; j < p; j++)
+                    cr += std::uint32_t(c[j]) * r[j];
+                if (cr != std::uint32_t(scale) * ab)
+                    equal = false;
+            }
+        });
+    }
+    return equal;
+}
+
+// Same check modulo the prime 2^31 - 1, where a wrong C passes a round with probability at most 2^-31. It
+// proves C == scale * A * B for exact (not overflowing) results whose errors aren't multiples of the prime.
+bool modularFreivaldsCheck(MatrixView A, MatrixView B, MatrixView C, int scale = 1, int rounds = 2,
+                           std::uint64_t seed = std::random_device{}(), int thread_count = std::thread::hardware_concurrency())
+{
+    if (A.col_count() != B.row_count() || B.col_count() != C.col_count() || A.row_count() != C.row_count())
+        return false;
+
+    constexpr std::uint32_t prime = 2147483647u;
+    BarrettReducer reducer(prime);
+    auto residue = [](int x) { return std::uint64_t((std::int64_t(x) % prime + prime) % prime); };
+
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+    if (n == 0 || m == 0 || p == 0)
+        return detail::empty_product_check(C);
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<std::uint64_t> distribution(0, prime - 1);
+    std::vector<std::uint64_t> r(p), y(m);
+    std::atomic<bool> equal = true;
+
+    // Every term is below prime^2 < 2^62, so adding one to a reduced sum can't overflow
+    auto dot = [&](const int* row, const std::vector<std::uint64_t>& x, int size)
+    {
+        std::uint64_t sum = 0;
+        for (int k = 0; k < size; k++)
+            sum = reducer.reduce(sum + residue(row[k]) * x[k]);
+        return sum;
+    };
+
+    for (int round = 0; round < rounds && equal; round++)
+    {
+        for (auto& value : r) value = distribution(rng);
+
+        detail::parallel_rows(m, thread_count, [&](int begin, int end)
+        {
+            for (int k = begin; k < end; k++)
+                y[k] = dot(B.pointer(k, 0), r, p);
+        });
+
+        detail::parallel_rows(n, thread_count, [&](int begin, int end)
+        {
+            for (int i = begin; i < end && equal.load(std::memory_order_relaxed); i++)
+                if (dot(C.pointer(i, 0), r, p) != reducer.reduce(residue(scale) * dot(A.pointer(i, 0), y, m)))
+                    equal = false;
+        });
+    }
+    return equal;
+}
@@ -14,6 +14,11 @@
 #include <ranges>
 #include <array>
 #include <set>
+#include <thread>
+#include <fstream>
+#include <memory>
+#include <list>
+#include <limits>
 
 #include "include/MatrixView.hpp"
 #include "include/iterative.hpp"
@@ -21,87 +26,243 @@
 #include "include/recursive.hpp"
 #include "include/MatrixMultiplier.hpp"
 #include "include/cmd_args.hpp"
+#include "include/benchmark.hpp"
+#include "include/report.hpp"
+#include "include/perf_counters.hpp"
+#include "include/trace.hpp"
+#include "include/cache_sim.hpp"
+#include "include/verify.hpp"
+#include "include/random_matrix.hpp"
+#include "include/blas.hpp"
+#include "include/matrix_file.hpp"
+#include "include/out_of_core.hpp"
+#include "include/distributed.hpp"
+#include "include/serve.hpp"
+#include "include/chain.hpp"
+#include "include/sparsity.hpp"
 
 using namespace std::string_view_literals;
 
-int generateRandomNumber(int min = 0, int max = 100) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> dis(min, max);
-    return dis(gen);
-}
+struct BenchmarkInputs
+{
+    std::vector<int> A, B, C;
+    std::vector<int> E; // A * B, only for full verification
+    std::shared_ptr<const MappedMatrix> A_file, B_file; // instead of A and B for inputs read from files
+    sparsity::Index A_index, B_index;                    // of A and B with zeroed tiles, dropped before them
+
+    std::size_t bytes() const { return (A.size() + B.size() + C.size() + E.size()) * sizeof(int); }
+
+    MatrixView A_view(int M) { return A_file ? A_file->view() : MatrixView(A, M); }
+    MatrixView B_view(int P) { return B_file ? B_file->view() : MatrixView(B, P); }
+    std::span<const int> A_data() const { return A_file ? A_file->data() : std::span<const int>(A); }
+    std::span<const int> B_data() const { return B_file ? B_file->data() : std::span<const int>(B); }
+};
 
-template<class F, bool verify>
-auto time(F f, int N, int M, int P)
+// Inputs of every shape, generated from seed so they are the same in every run and after eviction. Once they
+// take more than budget_bytes the least recently used shapes are dropped (never the one being returned).
+class InputCache
 {
-    static std::map<std::array<int, 3>, std::array<std::vector<int>, 4>> cache{};
-    auto it = cache.find({N, M, P});
-    if (it == cache.end())
-    {
-        std::vector<int> A(N * M);
-        std::vector<int> B(M * P);
-        std::vector<int> C(N * P);
+    std::list<std::pair<std::array<int, 3>, BenchmarkInputs>> entries; // most recently used first
 
-        std::vector<int> E(N * P);
+public:
+    std::size_t budget_bytes = std::size_t(1024) << 20;
+    std::uint64_t seed = 1;
+    std::shared_ptr<const MappedMatrix> A_file, B_file; // used instead of random A and B for their shape
+    double zero_tiles = 0; // fraction of the zeroed_tile_size tiles of random A and B that are zeroed and indexed
 
-        std::generate(A.begin(), A.end(), [](){ return generateRandomNumber(); });
-        std::generate(B.begin(), B.end(), [](){ return generateRandomNumber(); });
-        std::generate(C.begin(), C.end(), [](){ return generateRandomNumber(); });
+    static constexpr int zeroed_tile_size = 64;
 
-        MatrixView A_view(A, M);
-        MatrixView B_view(B, P);
-        MatrixView C_view(C, P);
+    // Zeroes tiles of the rows x cols matrix, each with probability zero_tiles (by stream of seed)
+    void zero_some_tiles(std::vector<int>& matrix, int rows, int cols, std::uint64_t stream) const
+    {
+        MatrixView view(matrix, cols, 0, rows, 0, cols);
+        int tile_cols = (cols + zeroed_tile_size - 1) / zeroed_tile_size;
+        for (int i = 0; i < rows; i += zeroed_tile_size)
+            for (int j = 0; j < cols; j += zeroed_tile_size)
+            {
+                std::uint64_t tile = std::uint64_t(i / zeroed_tile_size) * tile_cols + j / zeroed_tile_size;
+                if (double(counterRandom(seed ^ stream, tile) >> 11) * 0x1p-53 < zero_tiles)
+                    view.getSubMatrix(i, std::min(i + zeroed_tile_size, rows), j, std::min(j + zeroed_tile_size, cols)).clear();
+            }
+    }
+
+    BenchmarkInputs& get(int N, int M, int P, bool with_reference)
+    {
+        auto it = std::ranges::find(entries, std::array{N, M, P}, [](const auto& entry){ return entry.first; });
+        if (it != entries.end())
+            entries.splice(entries.begin(), entries, it);
+        else
+        {
+            BenchmarkInputs inputs;
+            inputs.C.resize(std::size_t(N) * P);
+            std::uint64_t stream = ((std::uint64_t(N) << 42) ^ (std::uint64_t(M) << 21) ^ std::uint64_t(P)) * 4;
+            randomFill(inputs.C, seed, stream + 2);
+
+            if (A_file && A_file->row_count() == N && A_file->col_count() == M && B_file->col_count() == P)
+            {
+                inputs.A_file = A_file;
+                inputs.B_file = B_file;
+            }
+            else
+            {
+                inputs.A.resize(std::size_t(N) * M);
+                inputs.B.resize(std::size_t(M) * P);
+                randomFill(inputs.A, seed, stream + 0);
+                randomFill(inputs.B, seed, stream + 1);
+                if (zero_tiles > 0)
+                {
+                    zero_some_tiles(inputs.A, N, M, stream + 0);
+                    zero_some_tiles(inputs.B, M, P, stream + 1);
+                    inputs.A_index = sparsity::Index(MatrixView(inputs.A, M, 0, N, 0, M));
+                    inputs.B_index = sparsity::Index(MatrixView(inputs.B, P, 0, M, 0, P));
+                }
+            }
+            entries.emplace_front(std::array{N, M, P}, std::move(inputs));
+        }
 
-        MatrixView E_view(E, P);
+        BenchmarkInputs& inputs = entries.front().second;
+        if (with_reference && inputs.E.empty())
+        {
+            inputs.E.resize(std::size_t(N) * P);
+            naiveCacheFriendlyMatMul(inputs.A_view(M), inputs.B_view(P), MatrixView(inputs.E, P), MatMulMode::Add);
+        }
 
-        if constexpr(verify) 
-            naiveCacheFriendlyMatMul(A_view, B_view, E_view, MatMulMode::Add);
+        auto total = [&]{ std::size_t sum = 0; for (const auto& entry : entries) sum += entry.second.bytes(); return sum; };
+        while (entries.size() > 1 && total() > budget_bytes)
+            entries.pop_back();
 
-        cache[{N, M, P}] = {std::move(A), std::move(B), std::move(C), std::move(E)};
-        it = cache.find({N, M, P});
+        return entries.front().second;
     }
+};
+
+InputCache& input_cache()
+{
+    static InputCache cache;
+    return cache;
+}
+
+struct ModeResult
+{
+    TimingStats stats;
+    bool check = true;
+    std::vector<std::optional<double>> counters; // per call
+    trace::Profile trace;                        // of one call
+    cachesim::Report cache;                      // of one call
+};
+
+struct TestResult
+{
+    ModeResult overwrite, add;
+};
+
+// Extra passes after the timed samples, so neither disturbs the timings
+struct Instrumentation
+{
+    PerfCounters* counters = nullptr;
+    bool trace = false;
+    bool cache_sim = false;
+};
 
-    std::vector<int>& A = it->second[0];
-    std::vector<int>& B = it->second[1];
-    std::vector<int>& C = it->second[2];
-    std::vector<int>& E = it->second[3];
+template<class F>
+TestResult time(F f, int N, int M, int P, std::optional<VerifyMethod> verify, const BenchmarkSettings& settings, Instrumentation instrumentation)
+{
+    BenchmarkInputs& inputs = input_cache().get(N, M, P, verify == VerifyMethod::Full);
+    std::vector<int>& C = inputs.C;
+    std::vector<int>& E = inputs.E;
 
-    MatrixView A_view(A, M);
-    MatrixView B_view(B, P);
+    MatrixView A_view = inputs.A_view(M);
+    MatrixView B_view = inputs.B_view(P);
     MatrixView C_view(C, P);
 
-    MatrixView E_view(E, P);
+    // In Add mode every call adds A * B to C again: C is restored before every sample (outside the timing) and
+    // a sample makes only as many calls as C can take without overflowing
+    std::vector<int> add_start;
+    long long add_calls = 1;
 
-    auto start = std::chrono::high_resolution_clock::now();
+    // The first warm-up run of each mode is the one that gets verified, the timed runs that follow only
+    // overwrite C or add to it
+    auto run_mode = [&](MatMulMode mode, auto check)
+    {
+        ModeResult result;
+        auto call = [&]{ f(A_view, B_view, C_view, mode); };
+        auto restore = [&]{ if (mode == MatMulMode::Add) std::ranges::copy(add_start, C.begin()); };
+        long long max_calls = mode == MatMulMode::Add ? add_calls : std::numeric_limits<long long>::max();
 
-    f(A_view, B_view, C_view, MatMulMode::Overwrite);
+        std::chrono::duration<double> last_call{};
+        for (int i = 0; i < std::max(settings.warmup_runs, 1); i++)
+        {
+            if (i > 0) restore();
+            auto start = std::chrono::steady_clock::now();
+            call();
+            last_call = std::chrono::steady_clock::now() - start;
+            if (i == 0 && verify)
+                result.check = check();
+        }
+        result.stats = measure(call, last_call, settings, restore, max_calls);
 
-    auto t_overwrite = std::chrono::high_resolution_clock::now() - start;
-    bool overwrite_check = verify ? C == E : true;
+        // One more sample with the counters enabled, so they don't count the timing and statistics code
+        if (auto counters = instrumentation.counters)
+        {
+            long long calls = std::max(result.stats.calls_per_sample, 1LL);
+            restore();
+            counters->start();
+            for (long long i = 0; i < calls; i++)
+                call();
+            counters->stop();
+            for (auto value : counters->read())
+                result.counters.push_back(value ? std::optional{*value / calls} : std::nullopt);
+        }
 
-    if constexpr(verify) 
-        std::ranges::for_each(E, [](int& x){ x *= 2; });
+        if (instrumentation.trace)
+        {
+            restore();
+            trace::start();
+            call();
+            result.trace = trace::stop();
+        }
+
+        if (instrumentation.cache_sim)
+        {
+            restore();
+            cachesim::start(std::as_bytes(inputs.A_data()), std::as_bytes(inputs.B_data()), std::as_bytes(std::span(C)));
+            call();
+            result.cache = cachesim::stop();
+        }
+        return result;
+    };
 
-    start = std::chrono::high_resolution_clock::now();
+    // C == scale * A * B
+    auto check = [&](int scale)
+    {
+        switch (*verify)
+        {
+            case VerifyMethod::Freivalds: return freivaldsCheck(A_view, B_view, C_view, scale);
+            case VerifyMethod::Modular:   return modularFreivaldsCheck(A_view, B_view, C_view, scale);
+            case VerifyMethod::Full:      return std::ranges::equal(C, E, [scale](int c, int e){ return c == scale * e; });
+        }
+        return false;
+    };
 
-    f(A_view, B_view, C_view, MatMulMode::Add);
+    TestResult result;
+    result.overwrite = run_mode(MatMulMode::Overwrite, [&]{ return check(1); });
 
-    auto t_add = std::chrono::high_resolution_clock::now() - start;
-    bool add_check = verify ? C == E : true;
+    // Overwrite mode leaves C == A * B, the first Add run must double it
+    f(A_view, B_view, C_view, MatMulMode::Overwrite);
+    add_start = C;
 
-    if constexpr(verify)
-        std::ranges::for_each(E, [](int& x){ x /= 2; });
+    // No element of A * B exceeds M * max|A| * max|B|
+    auto largest = [](std::span<const int> data)
+    {
+        double largest = 0;
+        for (int x : data) largest = std::max(largest, std::abs(double(x)));
+        return largest;
+    };
+    double per_call = double(M) * largest(inputs.A_data()) * largest(inputs.B_data());
+    double headroom = std::numeric_limits<int>::max() - largest(C);
+    add_calls = per_call > 0 ? (long long)std::clamp(headroom / per_call, 1.0, 1e18) : std::numeric_limits<long long>::max();
+    result.add = run_mode(MatMulMode::Add, [&]{ return check(2); });
 
-    if constexpr(verify)
-        return std::pair{ 
-            std::pair{ t_overwrite, overwrite_check }, 
-            std::pair{ t_add, add_check} 
-        };
-    
-    else
-        return std::pair{ 
-            t_overwrite, t_add
-        };
+    return result;
 }
 
 MatrixMultiplier recursive_until_size(int size)
@@ -114,22 +275,108 @@ MatrixMultiplier strassen_until_size(int size)
     return MatrixMultiplier::strassen_then([size](int n, int m, int p){ return n < size || m < size || p < size; }, MatrixMultiplier::naive_cache_friendly_mutliplier);
 }
 
-template<class F>
-void print_test(std::string_view name, F f, int N, int M, int P, bool verify = true)
+// Every dimension grows by the cube root of factor, so the work grows by factor
+std::array<int, 3> weak_scaled(std::array<int, 3> size, double factor)
 {
-    static auto to_ms = [](auto t){ return std::chrono::duration_cast<std::chrono::milliseconds>(t); };
+    double scale = std::cbrt(factor);
+    return {int(std::lround(size[0] * scale)), int(std::lround(size[1] * scale)), int(std::lround(size[2] * scale))};
+}
+
+std::string format_mode(const ModeResult& result, int N, int M, int P, MatMulMode mode, bool verify)
+{
+    const TimingStats& stats = result.stats;
+    double ops = 2.0 * N * M * P;
+    double bytes = (double(N) * M + double(M) * P + double(N) * P * (mode == MatMulMode::Add ? 2 : 1)) * sizeof(int);
+    std::string text = std::format("{:>9} +-{:>5.1f}% (min {:>9}, {:>4}x{:<6}) {:>7.2f} GOP/s {:>7.2f} GB/s",
+        format_duration(stats.median), stats.relative_error() * 100, format_duration(stats.min), stats.samples, stats.calls_per_sample,
+        stats.median > 0 ? ops / stats.median / 1e9 : 0, stats.median > 0 ? bytes / stats.median / 1e9 : 0);
     if (verify)
+        text += std::format(" {:>5}", result.check);
+    return text;
+}
+
+BenchmarkRecord make_record(const ModeResult& result, int N, int M, int P, MatMulMode mode, bool verify)
+{
+    BenchmarkRecord record;
+    record.n = N;
+    record.m = M;
+    record.p = P;
+    record.mode = mode == MatMulMode::Overwrite ? "overwrite" : "add";
+    record.stats = result.stats;
+    double bytes = (double(N) * M + double(M) * P + double(N) * P * (mode == MatMulMode::Add ? 2 : 1)) * sizeof(int);
+    record.gops = result.stats.median > 0 ? 2.0 * N * M * P / result.stats.median / 1e9 : 0;
+    record.gbps = result.stats.median > 0 ? bytes / result.stats.median / 1e9 : 0;
+    if (verify) record.check = result.check;
+    return record;
+}
+
+std::string format_counters(const ModeResult& result, const PerfCounters& counters)
+{
+    std::string text;
+    std::optional<double> cycles, instructions;
+    for (std::size_t i = 0; i < result.counters.size(); i++)
     {
-        auto res = time<F, true>(f, N, M, P);
-        std::cout << std::format("{}: OWT: {:>7} {:>5}, ADD: {:>7} {:>5}\n", name, to_ms(res.first.first), res.first.second, to_ms(res.second.first), res.second.second);
+        const std::string& name = counters.counters()[i].name;
+        const auto& value = result.counters[i];
+        text += std::format("{}{} {}", text.empty() ? "" : ", ", name, value ? format_count(*value) : "n/a");
+        if (name == "cycles") cycles = value;
+        if (name == "instructions") instructions = value;
     }
-    else
+    if (cycles && instructions && *cycles > 0)
+        text += std::format(", IPC {:.2f}", *instructions / *cycles);
+    return text;
+}
+
+// Words (ints) moved between each cache level and the one below it, reads/writes for C and scratch
+void print_cache_report(const cachesim::Report& report, std::string_view indent)
+{
+    auto words = [](std::uint64_t bytes){ return format_count(double(bytes / sizeof(int))); };
+
+    std::cout << std::format("{}{:<8} {:>5} {:>8} {:>8} {:>17} {:>17} {:>8}\n", indent, "level", "size", "A", "B", "C (r/w)", "scratch (r/w)", "total");
+
+    const auto& accesses = report.accesses;
+    std::cout << std::format("{}{:<8} {:>5} {:>8} {:>8} {:>17} {:>17} {:>8}\n", indent, "accesses", "", words(accesses[0]), words(accesses[1]),
+        words(accesses[2]), words(accesses[3]), words(accesses[0] + accesses[1] + accesses[2] + accesses[3]));
+
+    for (const auto& level : report.levels)
     {
-        auto res = time<F, false>(f, N, M, P);
-        std::cout << std::format("{}: OWT: {:>7}, ADD: {:>7}\n", name, to_ms(res.first), to_ms(res.second));
+        const auto& traffic = level.traffic;
+        std::uint64_t total = 0;
+        for (int i = 0; i < 4; i++) total += traffic.reads[i] + traffic.writes[i];
+        std::string size = level.size >= (1 << 20) ? std::format("{}M", level.size >> 20) : std::format("{}K", level.size >> 10);
+        std::cout << std::format("{}L{:<7} {:>5} {:>8} {:>8} {:>8}/{:<8} {:>8}/{:<8} {:>8}\n", indent, level.level, size,
+            words(traffic.reads[0]), words(traffic.reads[1]), words(traffic.reads[2]), words(traffic.writes[2]),
+            words(traffic.reads[3]), words(traffic.writes[3]), words(total));
     }
 }
 
+template<class F>
+TestResult print_test(std::string_view name, F f, int N, int M, int P, std::optional<VerifyMethod> verify, const BenchmarkSettings& settings, Instrumentation instrumentation)
+{
+    auto res = time(f, N, M, P, verify, settings, instrumentation);
+    std::cout << std::format("{}: OWT: {}, ADD: {}\n", name,
+        format_mode(res.overwrite, N, M, P, MatMulMode::Overwrite, verify.has_value()),
+        format_mode(res.add, N, M, P, MatMulMode::Add, verify.has_value()));
+    if (auto counters = instrumentation.counters)
+    {
+        std::cout << std::format("{:>{}}  OWT per call: {}\n", "", name.size(), format_counters(res.overwrite, *counters));
+        std::cout << std::format("{:>{}}  ADD per call: {}\n", "", name.size(), format_counters(res.add, *counters));
+    }
+    for (auto [mode_name, mode_result] : {std::pair{"OWT", &res.overwrite}, std::pair{"ADD", &res.add}})
+    {
+        if (mode_result->trace.empty()) continue;
+        std::cout << std::format("{:>{}}  {} strategies of one call:\n", "", name.size(), mode_name);
+        mode_result->trace.print_summary(std::cout, std::string(name.size() + 4, ' '));
+    }
+    for (auto [mode_name, mode_result] : {std::pair{"OWT", &res.overwrite}, std::pair{"ADD", &res.add}})
+    {
+        if (mode_result->cache.empty()) continue;
+        std::cout << std::format("{:>{}}  {} words moved by one call (simulated caches):\n", "", name.size(), mode_name);
+        print_cache_report(mode_result->cache, std::string(name.size() + 4, ' '));
+    }
+    return res;
+}
+
 struct TestableType
 {
     enum class Type
@@ -143,7 +390,10 @@ struct TestableType
         Recursive,
         Strassen,
         Hybrid,
-        Multithreaded
+        Multithreaded,
+        Blas,
+        Summa,
+        Summa25D
     } type;
     int val{0};
 
@@ -160,7 +410,7 @@ struct Testable
 {
     using MultiplierType = std::function<void(MatrixView, MatrixView, MatrixView, MatMulMode)>;
     Testable(std::string_view name, auto f) : name(name), f(f) {}
-    Testable(TestableType type)
+    Testable(TestableType type, std::size_t memory_budget = MatrixMultiplier::no_memory_budget)
     {
         switch(type.type)
         {
@@ -172,11 +422,41 @@ struct Testable
             case TestableType::BlockedMatMul:     f = cacheFriendlyBlockMatMul; break;
             case TestableType::Recursive:         f = recursive_until_size(type.val); break;
             case TestableType::Strassen:          f = strassen_until_size(type.val); break;
-            case TestableType::Hybrid:            f = MatrixMultiplier::hybrid_multiplier; break;
-            case TestableType::Multithreaded:     f = MatrixMultiplier::multithreaded_hybrid_multiplier; break;
+            case TestableType::Hybrid:
+                f = std::function<MultiplierType(int, int, int)>([memory_budget](int N, int M, int P) -> MultiplierType
+                {
+                    return MatrixMultiplier::hybrid_multiplier(N, M, P, memory_budget);
+                });
+                break;
+            case TestableType::Multithreaded:
+                threads = type.val ? type.val : std::max(1, int(std::thread::hardware_concurrency()));
+                f = std::function<MultiplierType(int, int, int)>([threads = threads, memory_budget](int N, int M, int P) -> MultiplierType
+                {
+                    return MatrixMultiplier::multithreaded_hybrid_multiplier(N, M, P, threads, memory_budget);
+                });
+                break;
+            case TestableType::Summa:
+            case TestableType::Summa25D:
+                threads = type.val * type.val * (type.type == TestableType::Summa25D ? 2 : 1); // processes
+                f = std::function<MultiplierType(int, int, int)>([grid = type.val, layers = threads / (type.val * type.val)](int N, int M, int P) -> MultiplierType
+                {
+                    auto block_multiplier = MatrixMultiplier::hybrid_multiplier(std::max(N / grid, 1), std::max(M / grid, 1), std::max(P / grid, 1));
+                    return [=](MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+                    {
+                        distributedMatMul(A, B, C, mode, grid, layers, block_multiplier);
+                    };
+                });
+                break;
+            case TestableType::Blas:
+#ifdef MATMUL_HAS_CBLAS
+                f = cblasMatMul;
+#endif
+                threads = std::max(1, int(std::thread::hardware_concurrency())); // the library's own threading
+                break;
         }
 
         name = name_from_type(type);
+        short_name = short_name_from_type(type);
     }
 
     static std::string short_name_from_type(TestableType type)
@@ -193,6 +473,9 @@ struct Testable
             case TestableType::Strassen:          return std::vformat("strassen{}", std::make_format_args(type.val)); break;
             case TestableType::Hybrid:            return "hybrid";
             case TestableType::Multithreaded:     return "multithreaded";
+            case TestableType::Blas:              return "blas";
+            case TestableType::Summa:             return std::format("summa{}", type.val);
+            case TestableType::Summa25D:          return std::format("summa25d{}", type.val);
         }
         return "";
     }
@@ -202,6 +485,7 @@ struct Testable
     {
         std::string val = std::format("{:<3}", type.val);
         if (placeholder && type.val == 0) val = std::format("{}", *placeholder);
+        std::string grid = report::trim(val);
         switch(type.type)
         {
             case TestableType::Naive:             return             "Naive                                  ";
@@ -213,12 +497,27 @@ struct Testable
             case TestableType::Recursive:         return std::format("Recursive until size {}               ", val); break;
             case TestableType::Strassen:          return std::format("Strassen  until size {}               ", val); break;
             case TestableType::Hybrid:            return             "Hybrid               (MatrixMultiplier)";
-            case TestableType::Multithreaded:     return             "Multithreaded hybrid (MatrixMultiplier)";
+            case TestableType::Multithreaded:
+                if (type.val) return std::format("{:<39}", std::format("Multithreaded hybrid ({} threads)", type.val));
+                return                                           "Multithreaded hybrid (MatrixMultiplier)";
+            case TestableType::Blas:              return             "CBLAS dgemm (baseline)                 ";
+            case TestableType::Summa:             return std::format("{:<39}", std::format("SUMMA      on {}x{} processes", grid, grid));
+            case TestableType::Summa25D:          return std::format("{:<39}", std::format("2.5D SUMMA on {}x{}x2 processes", grid, grid));
         }
         return "";
     }
 
+    std::optional<MultiplierType> multiplier_for(int N, int M, int P) const
+    {
+        if (std::holds_alternative<MultiplierType>(f))
+            return std::get<MultiplierType>(f);
+        if (std::holds_alternative<std::function<MultiplierType(int, int, int)>>(f))
+            return std::get<std::function<MultiplierType(int, int, int)>>(f)(N, M, P);
+        return std::nullopt;
+    }
+
     std::string short_name, name;
+    int threads = 1;
     std::variant<
         MultiplierType,
         std::function<MultiplierType(int)>,
@@ -272,6 +571,29 @@ struct TestConfig
     std::vector<Testable> tests;
     std::set<std::array<int, 3>> sizes;
     bool verify_results = false;
+    VerifyMethod verify_method = VerifyMethod::Freivalds;
+    std::uint64_t seed = 1;
+    std::size_t input_cache_mb = 1024;
+    double zero_tiles_percent = 0;
+    std::size_t memory_budget = MatrixMultiplier::no_memory_budget;
+    BenchmarkSettings benchmark;
+
+    std::string json_path, csv_path, baseline_path;
+    std::vector<std::string> input_paths;
+    std::string output_path, generate_path;
+    std::array<int, 2> generate_size{};
+    std::size_t out_of_core_mb = 0;
+    std::vector<int> chain_dims; // d0 x d1, d1 x d2, ... matrices
+    bool serve = false;
+    std::string serve_socket; // stdin and stdout if empty
+    double regression_threshold = 0.05;
+
+    std::vector<CounterSpec> counters;
+    std::string trace_path;
+    bool simulate_caches = false;
+
+    std::set<int> thread_counts;
+    bool weak_scaling = false;
 
     std::set<TestableType> tests_to_run;
     bool mult_parse_mode_with = true;
@@ -283,11 +605,13 @@ struct TestConfig
         if (arg == "default")
         {
             tests_to_run = default_tests;
+            if (hasCblas) tests_to_run.insert(TestableType::Blas);
             return;
         }
         if (arg == "all")
         {
             tests_to_run = all_tests;
+            if (hasCblas) tests_to_run.insert(TestableType::Blas);
             return;
         }
     }
@@ -307,10 +631,16 @@ struct TestConfig
         if (arg == "blocked_MatMul")      return {TestableType::BlockedMatMul};
         if (arg == "hybrid")              return {TestableType::Hybrid};
         if (arg == "multithreaded")       return {TestableType::Multithreaded};
+        if (arg == "blas")
+        {
+            if (hasCblas) return {TestableType::Blas};
+            std::cerr << "blas needs a build with a CBLAS library (found by CMake at configure time), skipped\n";
+            return std::nullopt;
+        }
 
-        if (arg.starts_with("recursive") || arg.starts_with("strassen"))
+        if (arg.starts_with("recursive") || arg.starts_with("strassen") || arg.starts_with("summa"))
         {
-            std::string_view name = arg.starts_with("recursive") ? "recursive" : "strassen";
+            std::string_view name = arg.starts_with("recursive") ? "recursive" : arg.starts_with("strassen") ? "strassen" : arg.starts_with("summa25d") ? "summa25d" : "summa";
             int size;
             try
             {
@@ -328,6 +658,12 @@ struct TestConfig
             }
             if (name == "recursive") return TestableType{TestableType::Recursive, size};
             if (name == "strassen")  return TestableType{TestableType::Strassen,  size};
+            if (name == "summa")     return TestableType{TestableType::Summa,     size};
+            if (name == "summa25d")
+            {
+                if (size >= 2) return TestableType{TestableType::Summa25D, size};
+                std::cerr << "2.5D SUMMA needs a grid of at least 2x2 for its 2 layers, {" << arg << "} skipped\n";
+            }
         }
 
         return std::nullopt;
@@ -360,9 +696,247 @@ struct TestConfig
         return size;
     } 
 
+    // from..to*factor (factor 2 if omitted) or from..to+step, or a single number
+    static std::optional<std::vector<int>> parse_range(std::string_view arg)
+    {
+        std::vector<int> values;
+        auto dots = arg.find("..");
+        try
+        {
+            if (dots == std::string_view::npos)
+            {
+                values.push_back(std::stoi(std::string(arg)));
+                return values;
+            }
+
+            auto op = arg.find_first_of("*+", dots + 2);
+            long long from = std::stoi(std::string(arg.substr(0, dots)));
+            long long to = std::stoi(std::string(arg.substr(dots + 2, op == std::string_view::npos ? std::string_view::npos : op - dots - 2)));
+            long long step = op == std::string_view::npos ? 2 : std::stoi(std::string(arg.substr(op + 1)));
+            bool geometric = op == std::string_view::npos || arg[op] == '*';
+            if (from <= 0 || to < from || step < (geometric ? 2 : 1) || (!geometric && (to - from) / step >= 1000))
+                return std::nullopt;
+
+            for (long long value = from; value <= to; value = geometric ? value * step : value + step)
+                values.push_back(int(value));
+        }
+        catch (std::exception& e)
+        {
+            return std::nullopt;
+        }
+        return values;
+    }
+
+    // N_M_P, or a single size or sweep of square shapes (see parse_range) optionally turned into a family of aspect ratio
+    // a_b_c with @a_b_c: every size s of the sweep gives the shape s*a _ s*b _ s*c
+    static std::vector<std::array<int, 3>> parse_sizes(std::string_view arg)
+    {
+        auto at = arg.find('@');
+        std::string_view sweep = arg.substr(0, at);
+        if (sweep.find('_') != std::string_view::npos && at == std::string_view::npos)
+        {
+            if (auto size = parse_size(arg)) return {*size};
+            return {};
+        }
+
+        std::array<int, 3> ratio{1, 1, 1};
+        if (at != std::string_view::npos)
+        {
+            auto parsed_ratio = parse_size(arg.substr(at + 1));
+            if (!parsed_ratio) return {};
+            ratio = *parsed_ratio;
+        }
+
+        auto values = parse_range(sweep);
+        if (!values)
+        {
+            std::cerr << "Invalid size sweep {" << arg << "} skipped\n";
+            return {};
+        }
+
+        std::vector<std::array<int, 3>> sizes;
+        for (int value : *values)
+            sizes.push_back({value * ratio[0], value * ratio[1], value * ratio[2]});
+        return sizes;
+    }
+
+    // Comma or space separated thread counts and ranges, like 1,2,4 or 1..16*2
+    void parse_thread_counts(const zen::cmd_args& args)
+    {
+        for (const auto& option : args.get_options("--threads"))
+            for (auto part : option | std::views::split(','))
+            {
+                std::string_view text(part.begin(), part.end());
+                if (text.empty()) continue;
+                auto values = parse_range(text);
+                if (!values) std::cerr << "Invalid thread count {" << text << "} skipped\n";
+                else         thread_counts.insert(values->begin(), values->end());
+            }
+    }
+
+    // Unsigned values are parsed as such, so negative ones and ones above max are rejected instead of wrapping
+    template<class T>
+    static void parse_number(const zen::cmd_args& args, std::string_view arg, T& value, T max = std::numeric_limits<T>::max())
+    {
+        auto options = args.get_options(arg);
+        if (options.empty())
+        {
+            // A dashed value like -1 isn't collected as an option
+            if (int at = args.find(arg); !args.arg_at(at).empty())
+                std::cerr << "Invalid value {" << args.arg_at(at + 1) << "} for " << arg << " skipped\n";
+            return;
+        }
+        try
+        {
+            if constexpr (std::is_unsigned_v<T>)
+            {
+                const std::string& text = options.front();
+                if (text.find('-') != std::string::npos)
+                    throw std::invalid_argument("negative");
+                unsigned long long parsed = std::stoull(text);
+                if (parsed > max)
+                    throw std::out_of_range("too large");
+                value = T(parsed);
+            }
+            else if constexpr (std::is_integral_v<T>) value = std::stoi(options.front());
+            else                                      value = std::stod(options.front());
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << "Invalid value {" << options.front() << "} for " << arg << " skipped\n";
+        }
+    }
+
+    void parse_benchmark_settings(const zen::cmd_args& args)
+    {
+        parse_number(args, "--warmup", benchmark.warmup_runs);
+        parse_number(args, "--min-samples", benchmark.min_samples);
+        parse_number(args, "--max-samples", benchmark.max_samples);
+
+        double relative_error_percent = benchmark.relative_error * 100;
+        parse_number(args, "--rel-error", relative_error_percent);
+        benchmark.relative_error = relative_error_percent / 100;
+
+        double max_time_ms = benchmark.max_time.count() * 1000;
+        parse_number(args, "--max-time", max_time_ms);
+        benchmark.max_time = std::chrono::duration<double>(max_time_ms / 1000);
+
+        benchmark.warmup_runs = std::max(benchmark.warmup_runs, 1);
+        benchmark.min_samples = std::max(benchmark.min_samples, 1);
+        benchmark.max_samples = std::max(benchmark.max_samples, benchmark.min_samples);
+    }
+
+    static std::string parse_path(const zen::cmd_args& args, std::string_view arg)
+    {
+        auto options = args.get_options(arg);
+        if (options.empty())
+        {
+            if (args.is_present(arg)) std::cerr << "Missing path for " << arg << " skipped\n";
+            return "";
+        }
+        return options.front();
+    }
+
     void parse_config(zen::cmd_args& args)
     {
         verify_results = args.is_present("--verify");
+        if (auto methods = args.get_options("--verify"); !methods.empty())
+        {
+            if      (methods.front() == "freivalds") verify_method = VerifyMethod::Freivalds;
+            else if (methods.front() == "modular")   verify_method = VerifyMethod::Modular;
+            else if (methods.front() == "full")      verify_method = VerifyMethod::Full;
+            else std::cerr << "Unknown verification method {" << methods.front() << "}, using freivalds\n";
+        }
+        parse_benchmark_settings(args);
+
+        if (auto options = args.get_options("--seed"); !options.empty())
+        {
+            try
+            {
+                seed = std::stoull(options.front());
+            }
+            catch (std::exception& e)
+            {
+                std::cerr << "Invalid value {" << options.front() << "} for --seed skipped\n";
+            }
+        }
+        parse_number(args, "--cache-mb", input_cache_mb, SIZE_MAX >> 20);
+        parse_number(args, "--zero-tiles", zero_tiles_percent);
+        zero_tiles_percent = std::clamp(zero_tiles_percent, 0.0, 100.0);
+        std::size_t memory_budget_mb = 0;
+        parse_number(args, "--memory-budget", memory_budget_mb, SIZE_MAX >> 20);
+        if (memory_budget_mb) memory_budget = memory_budget_mb << 20;
+
+        input_paths = args.get_options("--input");
+        if (!input_paths.empty() && input_paths.size() != 2)
+        {
+            std::cerr << "--input needs the files of A and B, skipped\n";
+            input_paths.clear();
+        }
+        output_path = parse_path(args, "--output");
+        parse_number(args, "--out-of-core", out_of_core_mb, SIZE_MAX >> 20);
+        if (auto options = args.get_options("--chain"); !options.empty())
+        {
+            try
+            {
+                for (auto part : options.front() | std::views::split('_'))
+                    chain_dims.push_back(std::stoi(std::string(part.begin(), part.end())));
+            }
+            catch (std::exception& e)
+            {
+                chain_dims.clear();
+            }
+            if (chain_dims.size() < 2 || std::ranges::any_of(chain_dims, [](int d){ return d <= 0; }))
+            {
+                std::cerr << "Invalid chain {" << options.front() << "} skipped\n";
+                chain_dims.clear();
+            }
+        }
+        else if (args.is_present("--chain"))
+            std::cerr << "--chain needs <d0>_<d1>_..._<dk>, skipped\n";
+        serve = args.is_present("--serve");
+        if (auto options = args.get_options("--serve"); !options.empty())
+            serve_socket = options.front();
+        if (auto options = args.get_options("--generate"); options.size() == 2)
+        {
+            auto size = parse_size(options[1] + "_1");
+            if (size) generate_path = options[0];
+            generate_size = {size ? (*size)[0] : 0, size ? (*size)[1] : 0};
+        }
+        else if (args.is_present("--generate"))
+            std::cerr << "--generate needs a path and <rows>_<cols>, skipped\n";
+
+        json_path = parse_path(args, "--json");
+        csv_path = parse_path(args, "--csv");
+        baseline_path = parse_path(args, "--compare");
+        double threshold_percent = regression_threshold * 100;
+        parse_number(args, "--threshold", threshold_percent);
+        regression_threshold = threshold_percent / 100;
+
+        if (args.is_present("--counters"))
+        {
+            auto names = args.get_options("--counters");
+            if (names.empty()) names = PerfCounters::default_names();
+            for (const auto& name : names)
+            {
+                if (auto counter = PerfCounters::parse(name)) counters.push_back(*counter);
+                else std::cerr << "Unknown or unsupported counter {" << name << "} skipped\n";
+            }
+        }
+
+        trace_path = parse_path(args, "--trace");
+        if (!trace_path.empty() && !trace::enabled)
+        {
+            std::cerr << "--trace needs a build with MATMUL_TRACE (cmake -DMATMUL_TRACE=ON), skipped\n";
+            trace_path.clear();
+        }
+
+        simulate_caches = args.is_present("--cache-sim");
+        if (simulate_caches && !cachesim::enabled)
+        {
+            std::cerr << "--cache-sim needs a build with MATMUL_CACHE_SIM (cmake -DMATMUL_CACHE_SIM=ON), skipped\n";
+            simulate_caches = false;
+        }
 
         for (bool first = true; const auto& arg: args.get_options("--mult")) 
         {
@@ -388,7 +962,20 @@ struct TestConfig
                 else                      tests_to_run.erase(*type);
             }
         }
-        for (const auto& arg: tests_to_run) tests.emplace_back(arg);
+        parse_thread_counts(args);
+        for (const auto& arg: tests_to_run)
+        {
+            if (arg.type == TestableType::Multithreaded && !thread_counts.empty())
+                for (int threads : thread_counts) tests.emplace_back(TestableType{TestableType::Multithreaded, threads}, memory_budget);
+            else
+                tests.emplace_back(arg, memory_budget);
+        }
+
+        if (auto options = args.get_options("--scaling"); !options.empty())
+        {
+            if (options.front() == "weak")        weak_scaling = true;
+            else if (options.front() != "strong") std::cerr << "Unknown scaling mode {" << options.front() << "}, using strong\n";
+        }
 
         for (bool first = true; const auto& arg: args.get_options("--sizes")) 
         {
@@ -408,10 +995,10 @@ struct TestConfig
                 size_parse_mode_with = false;
                 continue;
             }
-            if (auto size = parse_size(arg)) 
+            for (auto size : parse_sizes(arg))
             {
-                if (size_parse_mode_with) sizes.insert(*size);
-                else                      sizes.erase(*size);
+                if (size_parse_mode_with) sizes.insert(size);
+                else                      sizes.erase(size);
             }
         }
     }
@@ -424,13 +1011,73 @@ int main(int argc, char* argv[])
 
     if (argc == 1) 
     {
-        std::cout << "Usage: " << argv[0] << " [--help | -h] [--verify] [--mult [default | all] [[with | without] <test_name>]...] [--sizes [default] [[with | without] <size1_size2_size3>]...]\n";
+        std::cout << "Usage: " << argv[0] << " [--help | -h] [--verify [freivalds | modular | full]] [--counters [<counter>...]] [--trace <path>] [--cache-sim] [--seed <n>] [--cache-mb <n>] [--zero-tiles <percent>] [--memory-budget <MB>] [--input <A> <B>] [--output <C>] [--generate <path> <rows>_<cols>] [--out-of-core <MB>] [--serve [<socket>]] [--chain <d0>_<d1>_..._<dk>] [--json <path>] [--csv <path>] [--compare <baseline.json> [--threshold <percent>]] [--warmup <n>] [--min-samples <n>] [--max-samples <n>] [--rel-error <percent>] [--max-time <ms>] [--threads <counts>] [--scaling strong | weak] [--mult [default | all] [[with | without] <test_name>]...] [--sizes [default] [[with | without] <size1_size2_size3> | <sweep>]...]\n";
         std::cout << "Use --help or -h for detailed instructions.\n";
         return 0;
     }
     if (args.is_present("-h") || args.is_present("--help"))
     {
-        std::cout << "Usage: " << args.first() << " [--verify] [--mult [default | all] [[with | without] <test_name>]...] [--sizes [default] [[with | without] <size1_size2_size3>]...]\n";
+        std::cout << "Usage: " << args.first() << " [--verify [freivalds | modular | full]] [--counters [<counter>...]] [--trace <path>] [--cache-sim] [--seed <n>] [--cache-mb <n>] [--zero-tiles <percent>] [--memory-budget <MB>] [--input <A> <B>] [--output <C>] [--generate <path> <rows>_<cols>] [--out-of-core <MB>] [--serve [<socket>]] [--chain <d0>_<d1>_..._<dk>] [--json <path>] [--csv <path>] [--compare <baseline.json> [--threshold <percent>]] [--warmup <n>] [--min-samples <n>] [--max-samples <n>] [--rel-error <percent>] [--max-time <ms>] [--threads <counts>] [--scaling strong | weak] [--mult [default | all] [[with | without] <test_name>]...] [--sizes [default] [[with | without] <size1_size2_size3> | <sweep>]...]\n";
+        std::cout << "Verification (of the first warm-up run of each mode):\n";
+        std::cout << "\t--verify [freivalds]: Freivalds' check C * r == A * (B * r) with 8 random vectors, in the wrapping 32 bit\n";
+        std::cout << "\t                      arithmetic of the multiplication, O(n^2) (default)\n";
+        std::cout << "\t--verify modular:     the same check modulo the prime 2^31 - 1 with 2 random vectors\n";
+        std::cout << "\t--verify full:        compare with a naive cache friendly reference multiplication, O(n^3)\n\n";
+        std::cout << "Performance counters (Linux perf_event_open, counted per call in one extra sample of each mode):\n";
+        std::cout << "\t--counters [<counter>...]: cycles, instructions, l1d-misses, llc-misses, dtlb-misses, page-faults or\n";
+        std::cout << "\t                           raw=<hex event config> for CPU specific events (e.g. vector instruction counts);\n";
+        std::cout << "\t                           without names all the named counters are collected\n\n";
+        std::cout << "Strategy tracing (builds with -DMATMUL_TRACE=ON only):\n";
+        std::cout << "\t--trace <path>: trace one more call of each mode, print which strategy handled which sub-multiplications\n";
+        std::cout << "\t                and write the exclusive times as folded stacks (flamegraph.pl, speedscope) to <path>\n\n";
+        std::cout << "Data movement analysis (builds with -DMATMUL_CACHE_SIM=ON only, timings of such builds are meaningless):\n";
+        std::cout << "\t--cache-sim: run one more call of each mode through an LRU simulation of the detected caches and print\n";
+        std::cout << "\t             the words of A, B, C and scratch memory each level reads from and writes back to the next one\n\n";
+        std::cout << "Sweeps and scaling:\n";
+        std::cout << "\t--sizes <from>..<to>*<f>:   square sizes from, from*f, ... up to to (f = 2 when omitted)\n";
+        std::cout << "\t--sizes <from>..<to>+<s>:   square sizes from, from+s, ... up to to\n";
+        std::cout << "\t--sizes <sweep>@<a_b_c>:    shapes s*a _ s*b _ s*c for every size s of the sweep, e.g. 64..512@1_4_1\n";
+        std::cout << "\t--threads <counts>:         run multithreaded once per thread count, e.g. 1,2,4 or 1..16*2\n";
+        std::cout << "\t--scaling strong | weak:    strong keeps the shape, weak grows every dimension by the cube root of\n";
+        std::cout << "\t                            threads / fewest threads to keep the work per thread (default strong)\n";
+        std::cout << "\tWith more than one thread count the speedup and parallel efficiency relative to the fewest threads\n";
+        std::cout << "\tare printed after every size.\n\n";
+        std::cout << "Matrix files (a 64 byte header with the shape, element type, leading dimension and alignment, then the rows):\n";
+        std::cout << "\t--input <A> <B>:                  benchmark on these matrices (memory mapped, not copied) instead of --sizes\n";
+        std::cout << "\t--output <C>:                     write A * B of the first size, as computed by the first multiplier\n";
+        std::cout << "\t--generate <path> <rows>_<cols>: write a random matrix (from --seed and the path) and exit\n";
+        std::cout << "\t--out-of-core <MB>:               with --input and --output, multiply once in tiles that fit into this memory,\n";
+        std::cout << "\t                                  reading and writing tiles in the background, with the first multiplier\n\n";
+        std::cout << "Matrix chains:\n";
+        std::cout << "\t--chain <d0>_<d1>_..._<dk>: multiply random d0 x d1, d1 x d2, ... matrices with the first multiplier, left to\n";
+        std::cout << "\t                            right, in the order of fewest multiply-adds and in the fastest order by a cost\n";
+        std::cout << "\t                            model calibrated on the multiplier, and compare the estimated and measured times\n\n";
+        std::cout << "Job server (see include/serve.hpp for the protocol):\n";
+        std::cout << "\t--serve [<socket>]: multiply the jobs read from stdin (or every connection of a Unix socket) until their end,\n";
+        std::cout << "\t                    concurrently on the first --threads count of threads, each with the hybrid multiplier,\n";
+        std::cout << "\t                    keeping plans, mapped and packed input files (up to --cache-mb) between jobs\n";
+        std::cout << "\t                    mul <id> <A> <B> <C>:   C = A * B of matrix files\n";
+        std::cout << "\t                    mul <id> <N>_<M>_<P>:   followed by A and B as raw ints, replied to with C\n\n";
+        std::cout << "Output options:\n";
+        std::cout << "\t--json <path>, --csv <path>: also write every (multiplier, shape, mode, thread count) result to a file\n";
+        std::cout << "\t--compare <baseline.json>:   compare with results written by --json, exit with 1 on regressions\n";
+        std::cout << "\t--threshold <percent>:       slowdown of the median that counts as a regression when it is also\n";
+        std::cout << "\t                             statistically significant (Welch's t > 3) (default 5)\n";
+        std::cout << "\tWith --verify the exit code is also 1 if any result is wrong.\n\n";
+        std::cout << "Benchmark options:\n";
+        std::cout << std::format("\t--warmup <n>:           untimed runs per mode before measuring, the first one is verified (default {})\n", BenchmarkSettings{}.warmup_runs);
+        std::cout << std::format("\t--min-samples <n>:      samples taken before checking the confidence target (default {})\n", BenchmarkSettings{}.min_samples);
+        std::cout << std::format("\t--max-samples <n>:      upper limit of samples per mode (default {})\n", BenchmarkSettings{}.max_samples);
+        std::cout << std::format("\t--rel-error <percent>:  stop when the 95% confidence interval of the mean is within this (default {})\n", BenchmarkSettings{}.relative_error * 100);
+        std::cout << std::format("\t--max-time <ms>:        time budget per mode, at least one sample is always taken (default {})\n", BenchmarkSettings{}.max_time.count() * 1000);
+        std::cout << "\t--seed <n>:             seed of the random inputs, the same seed gives the same matrices (default 1)\n";
+        std::cout << "\t--cache-mb <n>:         memory for keeping the inputs of the shapes, least recently used first out (default 1024)\n";
+        std::cout << "\t--zero-tiles <percent>: zero this share of the 64 x 64 tiles of the random A and B and index their block sparsity,\n";
+        std::cout << "\t                        so the blocked, recursive and multithreaded strategies skip the zero products (default 0)\n";
+        std::cout << "\t--memory-budget <MB>:   scratch memory the hybrid and multithreaded multipliers may hold at once, strategies that\n";
+        std::cout << "\t                        would exceed it fall back to the next ones of the chain (default unlimited)\n";
+        std::cout << "\tEach mode reports the median time per call +- the confidence interval, the minimum, samples x calls per sample,\n";
+        std::cout << "\tthe integer operations per second (2*N*M*P) and the bandwidth of reading A and B and writing (or updating) C once.\n\n";
         std::cout << "Available multipliers:\n";
         for (const auto& type: 
             {
@@ -443,22 +1090,32 @@ int main(int argc, char* argv[])
                 TestableType::Recursive,
                 TestableType::Strassen,
                 TestableType::Hybrid,
-                TestableType::Multithreaded
+                TestableType::Multithreaded,
+                TestableType::Blas,
+                TestableType::Summa,
+                TestableType::Summa25D
             })
         {
             auto name = Testable::short_name_from_type(type);
             if (name == "recursive" || name == "strassen")
                 std::cout << "\t" << name << "<size>: ";
+            else if (name.starts_with("summa"))
+                std::cout << "\t" << name.substr(0, name.size() - 1) << "<grid>: ";
             else std::cout << "\t" << name << ": ";
-            std::cout << Testable::name_from_type(type, std::optional{"<size>"}) << "\n";
+            std::cout << Testable::name_from_type(type, std::optional{name.starts_with("summa") ? "<grid>" : "<size>"});
+            if (type == TestableType::Blas)
+                std::cout << (hasCblas ? " (the other results are also printed as a percentage of it)" : " (not available, no CBLAS was found at configure time)");
+            std::cout << "\n";
         }
         std::cout << "\n\tdefault:\n";
         for (const auto& type: TestConfig::default_tests)
             std::cout << "\t\t" << Testable::short_name_from_type(type) << "\n";
+        if (hasCblas) std::cout << "\t\tblas\n";
         
         std::cout << "\n\tall:\n";
         for (const auto& type: TestConfig::all_tests)
             std::cout << "\t\t" << Testable::short_name_from_type(type) << "\n";
+        if (hasCblas) std::cout << "\t\tblas\n";
 
         std::cout << "\ndefault sizes:\n";
         for (const auto& size: TestConfig::default_sizes)
@@ -470,28 +1127,257 @@ int main(int argc, char* argv[])
     TestConfig config;
     config.parse_config(args);
 
+    std::optional<std::vector<BenchmarkRecord>> baseline;
+    if (!config.baseline_path.empty())
+    {
+        baseline = report::read_json(config.baseline_path);
+        if (!baseline)
+        {
+            std::cerr << "Can't read baseline {" << config.baseline_path << "}\n";
+            return 2;
+        }
+    }
+
+    if (!config.generate_path.empty())
+    {
+        auto matrix = MappedMatrix::create(config.generate_path, config.generate_size[0], config.generate_size[1]);
+        if (!matrix)
+        {
+            std::cerr << "Can't write matrix {" << config.generate_path << "}\n";
+            return 2;
+        }
+        randomFill(matrix->data(), config.seed, std::hash<std::string>{}(config.generate_path)); // different files, different numbers
+        matrix->flush();
+        std::cout << std::format("Wrote a {}x{} matrix to {}\n", matrix->row_count(), matrix->col_count(), config.generate_path);
+        return 0;
+    }
+
+    // One chain product in three orders
+    if (!config.chain_dims.empty())
+    {
+        Testable test = config.tests.empty() ? Testable(TestableType::Hybrid, config.memory_budget) : config.tests.front();
+        auto multiply = [&test](MatrixView A, MatrixView B, MatrixView C, MatMulMode mode)
+        {
+            if (auto f = test.multiplier_for(A.row_count(), A.col_count(), B.col_count()))
+                (*f)(A, B, C, mode);
+        };
+
+        const auto& dims = config.chain_dims;
+        int k = int(dims.size()) - 1;
+        std::vector<std::vector<int>> data(k);
+        std::vector<MatrixView> matrices;
+        for (int i = 0; i < k; i++)
+        {
+            data[i].resize(std::size_t(dims[i]) * dims[i + 1]);
+            randomFill(data[i], config.seed, std::uint64_t(i), -10, 10);
+            matrices.emplace_back(data[i], dims[i + 1]);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        ChainCostModel model = ChainCostModel::calibrated(multiply);
+        std::cout << std::format("Calibrated the cost model of {} in {}\n", test.short_name, format_duration(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()));
+
+        std::vector<int> expected;
+        bool match = true;
+        ChainBufferPool pool;
+        for (auto [label, plan] : {std::pair{"left to right", leftToRightChainPlan(dims, model)},
+                                   std::pair{"fewest flops", matrixChainPlan(dims, ChainCostModel::flops())},
+                                   std::pair{"calibrated", matrixChainPlan(dims, model)}})
+        {
+            std::vector<int> C(std::size_t(dims.front()) * dims.back());
+            auto call = [&] { chainMatMul(matrices, MatrixView(C, dims.back()), MatMulMode::Overwrite, plan, multiply, pool); };
+            auto first = std::chrono::steady_clock::now();
+            call();
+            TimingStats stats = measure(call, std::chrono::steady_clock::now() - first, config.benchmark);
+
+            if (expected.empty()) expected = C;
+            else match = match && C == expected;
+            std::cout << std::format("{:<14}: {:<40} estimated {:>9}, measured {:>9}\n", label, plan.to_string(), format_duration(plan.estimate(model)), format_duration(stats.median));
+        }
+        std::cout << (match ? "All orders give the same product\n" : "The orders give different products\n");
+        return match ? 0 : 1;
+    }
+
+    // A long-lived worker instead of a benchmark
+    if (config.serve)
+    {
+        int threads = config.thread_counts.empty() ? std::max(1, int(std::thread::hardware_concurrency())) : *config.thread_counts.begin();
+        JobServer server([memory_budget = config.memory_budget](int N, int M, int P)
+        {
+            return MatrixMultiplier::hybrid_multiplier(N, M, P, memory_budget);
+        }, threads, config.input_cache_mb << 20);
+
+        if (config.serve_socket.empty())
+            server.serve(0, 1);
+        else if (!server.listen(config.serve_socket))
+        {
+            std::cerr << "Can't listen on {" << config.serve_socket << "}\n";
+            return 2;
+        }
+        return 0;
+    }
+
+    // One multiplication of files of any size, in tiles that fit into the memory given
+    if (config.out_of_core_mb)
+    {
+        if (config.input_paths.empty() || config.output_path.empty())
+        {
+            std::cerr << "--out-of-core needs --input and --output\n";
+            return 2;
+        }
+        auto A = MatrixFile::open(config.input_paths[0]);
+        auto B = MatrixFile::open(config.input_paths[1]);
+        if (!A || !B || A->col_count() != B->row_count())
+        {
+            std::cerr << "Can't read matrices {" << config.input_paths[0] << "} and {" << config.input_paths[1] << "} or multiply them\n";
+            return 2;
+        }
+        std::uint64_t N = A->row_count(), M = A->col_count(), P = B->col_count();
+        auto C = MatrixFile::create(config.output_path, N, P);
+        if (!C)
+        {
+            std::cerr << "Can't write matrix {" << config.output_path << "}\n";
+            return 2;
+        }
+
+        std::size_t memory = config.out_of_core_mb << 20;
+        OutOfCoreTiling tiling = outOfCoreTiling(N, M, P, memory);
+        Testable test = config.tests.empty() ? Testable(TestableType::Hybrid, config.memory_budget) : config.tests.front();
+        auto f = test.multiplier_for(tiling.rows, tiling.depth, tiling.cols);
+        if (!f)
+            return 2;
+
+        auto start = std::chrono::steady_clock::now();
+        OutOfCoreStats stats = outOfCoreMatMul(*A, *B, *C, MatMulMode::Overwrite, memory, *f);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!stats.ok)
+        {
+            std::cerr << "Reading or writing the matrix files failed\n";
+            return 2;
+        }
+        std::cout << std::format("{}x{}x{} out of core with {}: {}, {:.2f} GOP/s, tiles {}x{}x{}, read {:.1f} MB, wrote {:.1f} MB, waited {} for I/O\n",
+            N, M, P, test.short_name, format_duration(seconds), 2.0 * N * M * P / seconds / 1e9, tiling.rows, tiling.cols, tiling.depth,
+            stats.bytes_read / 1e6, stats.bytes_written / 1e6, format_duration(stats.io_wait));
+        return 0;
+    }
+
+    if (!config.input_paths.empty())
+    {
+        std::array<std::shared_ptr<const MappedMatrix>, 2> inputs;
+        for (int i = 0; i < 2; i++)
+        {
+            auto matrix = MappedMatrix::open(config.input_paths[i]);
+            if (!matrix)
+            {
+                std::cerr << "Can't read matrix {" << config.input_paths[i] << "}\n";
+                return 2;
+            }
+            inputs[i] = std::make_shared<const MappedMatrix>(std::move(*matrix));
+        }
+        if (inputs[0]->col_count() != inputs[1]->row_count())
+        {
+            std::cerr << std::format("Can't multiply a {}x{} matrix with a {}x{} one\n", inputs[0]->row_count(), inputs[0]->col_count(), inputs[1]->row_count(), inputs[1]->col_count());
+            return 2;
+        }
+        input_cache().A_file = inputs[0];
+        input_cache().B_file = inputs[1];
+        config.sizes = {{inputs[0]->row_count(), inputs[0]->col_count(), inputs[1]->col_count()}};
+    }
+
+    std::unique_ptr<PerfCounters> counters;
+    if (!config.counters.empty())
+    {
+        counters = std::make_unique<PerfCounters>(config.counters);
+        if (!counters->any_available())
+            std::cerr << "None of the requested performance counters can be opened (unsupported platform, CPU or perf_event_paranoid setting)\n";
+    }
+
+    std::ofstream trace_file;
+    if (!config.trace_path.empty())
+    {
+        trace_file.open(config.trace_path);
+        if (!trace_file.is_open())
+            std::cerr << "Can't write trace {" << config.trace_path << "}\n";
+    }
+    Instrumentation instrumentation{counters.get(), trace_file.is_open(), config.simulate_caches};
+
     std::cout << "CTEST_FULL_OUTPUT\n";
     
+    std::optional<VerifyMethod> verify;
+    if (config.verify_results) verify = config.verify_method;
+
+    input_cache().seed = config.seed;
+    input_cache().budget_bytes = config.input_cache_mb << 20;
+    input_cache().zero_tiles = config.zero_tiles_percent / 100;
+
+    std::vector<BenchmarkRecord> records;
     for (const auto& size: config.sizes)
     {
-        int N = size[0];
-        int M = size[1];
-        int P = size[2];
-        std::cout << "N: " << N << ", M: " << M << ", P: " << P << '\n';
+        std::cout << "N: " << size[0] << ", M: " << size[1] << ", P: " << size[2] << '\n';
+        std::size_t size_records = records.size();
+        int min_threads = config.tests.empty() ? 1 : std::ranges::min(config.tests, {}, &Testable::threads).threads;
         for (const auto& test: config.tests)
         {
-            if (std::holds_alternative<Testable::MultiplierType>(test.f))
-            {
-                auto f = std::get<Testable::MultiplierType>(test.f);
-                print_test(test.name, f, N, M, P, config.verify_results);
-            }
-            else if (std::holds_alternative<std::function<Testable::MultiplierType(int, int, int)>>(test.f))
+            // Weak scaling keeps the work per thread constant, relative to the test with the fewest threads
+            auto [N, M, P] = config.weak_scaling ? weak_scaled(size, double(test.threads) / min_threads) : size;
+            std::string name = test.name;
+            if (config.weak_scaling && (N != size[0] || M != size[1] || P != size[2]))
+                name = std::format("{:<39}", std::format("{} @{}_{}_{}", report::trim(test.name), N, M, P));
+
+            std::optional<TestResult> result;
+            if (auto f = test.multiplier_for(N, M, P))
+                result = print_test(name, *f, N, M, P, verify, config.benchmark, instrumentation);
+
+            if (!result) continue;
+            for (auto [mode_result, mode] : {std::pair{result->overwrite, MatMulMode::Overwrite}, std::pair{result->add, MatMulMode::Add}})
             {
-                auto f = std::get<std::function<Testable::MultiplierType(int, int, int)>>(test.f)(N, M, P);
-                print_test(test.name, f, N, M, P, config.verify_results);
+                BenchmarkRecord record = make_record(mode_result, N, M, P, mode, config.verify_results);
+                record.multiplier = test.short_name;
+                record.name = test.name;
+                record.threads = test.threads;
+                for (std::size_t i = 0; i < mode_result.counters.size(); i++)
+                    record.counters.emplace_back(counters->counters()[i].name, mode_result.counters[i]);
+                mode_result.trace.write_folded(trace_file, std::format("{};{}_{}_{};{}", test.short_name, N, M, P, record.mode));
+                records.push_back(std::move(record));
             }
         }
+        report::print_scaling(std::cout, std::span(records).subspan(size_records), config.weak_scaling);
+        report::print_relative(std::cout, std::span(records).subspan(size_records), "blas");
+    }
+
+    // C = A * B of the first shape (the one of --input) by the first multiplier
+    if (!config.output_path.empty() && !config.sizes.empty() && !config.tests.empty())
+    {
+        auto [N, M, P] = *config.sizes.begin();
+        BenchmarkInputs& inputs = input_cache().get(N, M, P, false);
+        auto C = MappedMatrix::create(config.output_path, N, P);
+        auto f = config.tests.front().multiplier_for(N, M, P);
+        if (!C || !f)
+        {
+            std::cerr << "Can't write matrix {" << config.output_path << "}\n";
+            return 2;
+        }
+        (*f)(inputs.A_view(M), inputs.B_view(P), C->view(), MatMulMode::Overwrite);
+        C->flush();
+        std::cout << std::format("Wrote C = A * B ({}) to {}\n", report::trim(config.tests.front().name), config.output_path);
+    }
+
+    if (!config.json_path.empty())
+    {
+        std::ofstream file(config.json_path);
+        report::write_json(file, records);
+    }
+    if (!config.csv_path.empty())
+    {
+        std::ofstream file(config.csv_path);
+        report::write_csv(file, records);
     }
 
-    return 0;
+    int exit_code = 0;
+    if (config.verify_results && std::ranges::any_of(records, [](const auto& r){ return r.check == false; }))
+        exit_code = 1;
+    if (baseline && report::compare(*baseline, records, config.regression_threshold, std::cout) > 0)
+        exit_code = 1;
+
+    return exit_code;
 }
\ No newline at end of file
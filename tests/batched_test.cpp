@@ -0,0 +1,122 @@
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "../include/MatrixMultiplier.hpp"
+#include "../include/random_matrix.hpp"
+
+struct Product
+{
+    int n, m, p;
+    std::vector<int> A, B, C, start;
+};
+
+// start + A * B (or A * B), wrapping like the multipliers do
+bool check(const char* name, const Product& product, MatMulMode mode, const std::vector<int>& C)
+{
+    auto& [n, m, p, A, B, _, start] = product;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < p; j++)
+        {
+            std::uint32_t expected = mode == MatMulMode::Add ? std::uint32_t(start[i * p + j]) : 0;
+            for (int k = 0; k < m; k++)
+                expected += std::uint32_t(A[i * m + k]) * std::uint32_t(B[k * p + j]);
+            if (std::uint32_t(C[i * p + j]) != expected)
+            {
+                std::cerr << name << ' ' << n << 'x' << m << 'x' << p << (mode == MatMulMode::Add ? " add" : " overwrite")
+                          << ": C(" << i << ", " << j << ") is " << C[i * p + j] << ", expected " << int(expected) << '\n';
+                return false;
+            }
+        }
+    return true;
+}
+
+// Both batched overloads against naive products, for a batch of mixed shapes (including empty inner dimensions
+// and vectors) with single and multithreaded chains and several thread counts. Every product must run on one
+// thread: the multithreaded strategies inside it see a budget of one.
+int main()
+{
+    bool ok = true;
+
+    std::vector<Product> products;
+    struct Shape { int n, m, p, count; };
+    std::uint64_t stream = 0;
+    for (auto [n, m, p, count] : {Shape{200, 150, 170, 2}, Shape{3, 5, 7, 10}, Shape{64, 1, 64, 2}, Shape{40, 0, 30, 1}, Shape{1, 50, 60, 3}, Shape{90, 90, 1, 2}})
+        for (int c = 0; c < count; c++)
+        {
+            Product product{n, m, p, std::vector<int>(n * m), std::vector<int>(m * p), {}, std::vector<int>(n * p)};
+            randomFill(product.A, 1, stream++, -100, 100);
+            randomFill(product.B, 1, stream++, -100, 100);
+            randomFill(product.start, 1, stream++, -100, 100);
+            products.push_back(std::move(product));
+        }
+
+    for (MatrixMultiplier multiplier : {MatrixMultiplier::hybrid_multiplier(256, 256, 256), MatrixMultiplier::multithreaded_hybrid_multiplier(256, 256, 256, 4)})
+        for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+            for (int threads : {1, 3, 8})
+            {
+                std::vector<std::array<MatrixView, 3>> batch;
+                for (auto& product : products)
+                {
+                    product.C = product.start;
+                    batch.push_back({MatrixView(std::span<int>(product.A), product.m, 0, product.n, 0, product.m),
+                                     MatrixView(std::span<int>(product.B), product.p, 0, product.m, 0, product.p),
+                                     MatrixView(product.C, product.p)});
+                }
+                multiplier.batched(batch, mode, threads);
+                for (auto& product : products)
+                    if (!check("batch", product, mode, product.C))
+                    {
+                        ok = false;
+                        break;
+                    }
+            }
+
+    // Strided: matrices further apart than their size
+    constexpr int count = 6, n = 33, m = 21, p = 17, gap = 5;
+    std::vector<int> A(count * (n * m + gap)), B(count * (m * p + gap)), C(count * (n * p + gap));
+    randomFill(A, 2, 0, -100, 100);
+    randomFill(B, 2, 1, -100, 100);
+    randomFill(C, 2, 2, -100, 100);
+    std::vector<int> start = C;
+    for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+    {
+        C = start;
+        MatrixMultiplier::hybrid_multiplier(n, m, p).batched(StridedMatrixBatch(A, count, n, m, n * m + gap), StridedMatrixBatch(B, count, m, p, m * p + gap),
+                                                             StridedMatrixBatch(C, count, n, p, n * p + gap), mode, 4);
+        for (int i = 0; i < count; i++)
+        {
+            auto matrix = [&](const std::vector<int>& data, int size) { return std::vector<int>(data.begin() + i * (size + gap), data.begin() + i * (size + gap) + size); };
+            Product product{n, m, p, matrix(A, n * m), matrix(B, m * p), {}, matrix(start, n * p)};
+            ok &= check("strided", product, mode, matrix(C, n * p));
+        }
+        for (int i = 0; i < count; i++)
+            for (int g = 0; g < gap; g++)
+                if (C[i * (n * p + gap) + n * p + g] != start[i * (n * p + gap) + n * p + g])
+                {
+                    std::cerr << "strided: the gap after C " << i << " was written\n";
+                    ok = false;
+                }
+    }
+
+    // The budget the strategies inside a batch see
+    std::atomic<int> largest_budget = 0;
+    MatrixMultiplier recording = MatrixMultiplier::one_strategy([&](const MatrixMultiplier&, MatrixView, MatrixView, MatrixView, MatMulMode)
+    {
+        int budget = MatrixMultiplier::MultithreadedRecursiveMultiplier::inherited_budget;
+        int seen = largest_budget;
+        while (budget > seen && !largest_budget.compare_exchange_weak(seen, budget));
+    });
+    std::vector<std::array<MatrixView, 3>> batch;
+    for (auto& product : products)
+        batch.push_back({MatrixView(product.A, product.m), MatrixView(product.B, product.p), MatrixView(product.C, product.p)});
+    recording.batched(batch, MatMulMode::Overwrite, 4);
+    if (largest_budget != 1)
+    {
+        std::cerr << "A product of the batch had a thread budget of " << largest_budget << '\n';
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../include/chain.hpp"
+#include "../include/MatrixMultiplier.hpp"
+
+// The product of the chain left to right, naively, wrapping like the multipliers do
+std::vector<std::uint32_t> naiveChain(const std::vector<std::vector<int>>& matrices, const std::vector<int>& dims)
+{
+    std::vector<std::uint32_t> product(matrices[0].begin(), matrices[0].end());
+    for (std::size_t t = 1; t < matrices.size(); t++)
+    {
+        int n = dims[0], m = dims[t], p = dims[t + 1];
+        std::vector<std::uint32_t> next(std::size_t(n) * p, 0);
+        for (int i = 0; i < n; i++)
+            for (int k = 0; k < m; k++)
+                for (int j = 0; j < p; j++)
+                    next[std::size_t(i) * p + j] += product[std::size_t(i) * m + k] * std::uint32_t(matrices[t][std::size_t(k) * p + j]);
+        product = std::move(next);
+    }
+    return product;
+}
+
+// matrixChainPlan against the textbook instance, and chainMatMul against the naive product left to right, in both
+// modes, for single matrices, pairs and longer chains, reusing one buffer pool
+int main()
+{
+    bool ok = true;
+
+    // CLRS 15.2: the optimum is 15125 multiply-adds, ((A1 (A2 A3)) ((A4 A5) A6)) counting from 1
+    std::vector<int> textbook{30, 35, 15, 5, 10, 20, 25};
+    ChainPlan plan = matrixChainPlan(textbook, ChainCostModel::flops());
+    if (plan.cost != 15125 || plan.to_string() != "((A0 (A1 A2)) ((A3 A4) A5))" || plan.estimate(ChainCostModel::flops()) != 15125)
+    {
+        std::cerr << "textbook chain: " << plan.to_string() << " costs " << plan.cost << ", expected ((A0 (A1 A2)) ((A3 A4) A5)) at 15125\n";
+        ok = false;
+    }
+    ChainPlan in_order = leftToRightChainPlan(textbook, ChainCostModel::flops());
+    if (in_order.cost != 40500 || in_order.to_string() != "(((((A0 A1) A2) A3) A4) A5)" || in_order.estimate(ChainCostModel::flops()) != 40500)
+    {
+        std::cerr << "textbook chain left to right: " << in_order.to_string() << " costs " << in_order.cost << ", expected 40500\n";
+        ok = false;
+    }
+
+    ChainBufferPool pool;
+    std::uint64_t stream = 0;
+    for (const std::vector<int>& dims : {std::vector<int>{13, 17}, std::vector<int>{9, 1, 12}, textbook, std::vector<int>{7, 1, 40, 3, 22, 9, 1, 15}, std::vector<int>{50, 60, 2, 70, 3}})
+    {
+        int k = int(dims.size()) - 1;
+        std::vector<std::vector<int>> matrices(k);
+        std::vector<MatrixView> views;
+        for (int t = 0; t < k; t++)
+        {
+            matrices[t].resize(std::size_t(dims[t]) * dims[t + 1]);
+            randomFill(matrices[t], 1, stream++, -20, 20);
+            views.push_back(MatrixView(matrices[t], dims[t + 1]));
+        }
+        std::vector<std::uint32_t> product = naiveChain(matrices, dims);
+
+        std::vector<int> start(std::size_t(dims[0]) * dims[k]);
+        randomFill(start, 1, stream++, -100, 100);
+        MatrixMultiplier multiplier = MatrixMultiplier::hybrid_multiplier(64, 64, 64);
+        ChainPlan chain_plan = matrixChainPlan(dims, ChainCostModel::flops());
+        for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+            for (bool with_pool : {false, true})
+            {
+                std::vector<int> C = start;
+                if (with_pool) chainMatMul(views, MatrixView(C, dims[k]), mode, chain_plan, multiplier, pool);
+                else           chainMatMul(views, MatrixView(C, dims[k]), mode, multiplier);
+                for (std::size_t i = 0; i < C.size(); i++)
+                {
+                    std::uint32_t expected = product[i] + (mode == MatMulMode::Add ? std::uint32_t(start[i]) : 0);
+                    if (std::uint32_t(C[i]) != expected)
+                    {
+                        std::cerr << "chain of " << k << (mode == MatMulMode::Add ? " add" : " overwrite") << (with_pool ? " with a pool" : "")
+                                  << ": element " << i << " is " << C[i] << ", expected " << int(expected) << '\n';
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <future>
+#include "../include/executor.hpp"
+#include "../include/random_matrix.hpp"
+
+// Small requests queued behind a big one, while the only worker is busy, must finish before the big one
+int main()
+{
+    std::promise<void> started, release;
+    std::shared_future<void> released = release.get_future().share();
+    MatrixMultiplier blocking = MatrixMultiplier::one_strategy([&](const MatrixMultiplier&, MatrixView, MatrixView, MatrixView, MatMulMode)
+    {
+        started.set_value();
+        released.wait();
+    });
+    MatrixMultiplier multiplier = MatrixMultiplier::hybrid_multiplier(512, 512, 512);
+
+    std::vector<int> one(1), big_A(512 * 512), big_B(512 * 512), big_C(512 * 512);
+    randomFill(big_A, 1, 0);
+    randomFill(big_B, 1, 1);
+    std::vector<std::vector<int>> small(9, std::vector<int>(4));
+    for (std::size_t i = 0; i < small.size(); i++)
+        randomFill(small[i], 1, 2 + i);
+
+    std::mutex mutex;
+    std::vector<std::string> finished;
+    auto done = [&](std::string name)
+    {
+        return [&, name](std::exception_ptr)
+        {
+            std::lock_guard lock(mutex);
+            finished.push_back(name);
+        };
+    };
+
+    {
+        MatMulExecutor executor(1);
+        executor.submit(blocking, MatrixView(one, 1), MatrixView(one, 1), MatrixView(one, 1), MatMulMode::Overwrite, done("blocking"));
+        started.get_future().wait();
+
+        executor.submit(multiplier, MatrixView(big_A, 512), MatrixView(big_B, 512), MatrixView(big_C, 512), MatMulMode::Overwrite, done("big"));
+        for (int i = 0; i < 3; i++)
+            executor.submit(multiplier, MatrixView(small[3 * i], 2), MatrixView(small[3 * i + 1], 2), MatrixView(small[3 * i + 2], 2),
+                            MatMulMode::Overwrite, done("small"));
+
+        release.set_value();
+        executor.wait_idle();
+    }
+
+    std::vector<std::string> expected{"blocking", "small", "small", "small", "big"};
+    if (finished != expected)
+    {
+        std::cerr << "Requests finished in the order";
+        for (const auto& name : finished) std::cerr << ' ' << name;
+        std::cerr << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "../include/expression.hpp"
+#include "../include/MatrixMultiplier.hpp"
+#include "../include/random_matrix.hpp"
+
+// The n x p product of A (n x m) and B (m x p), wrapping like the multipliers do
+std::vector<std::uint32_t> naiveProduct(const std::vector<int>& A, const std::vector<int>& B, int n, int m, int p)
+{
+    std::vector<std::uint32_t> C(std::size_t(n) * p, 0);
+    for (int i = 0; i < n; i++)
+        for (int k = 0; k < m; k++)
+            for (int j = 0; j < p; j++)
+                C[std::size_t(i) * p + j] += std::uint32_t(A[std::size_t(i) * m + k]) * std::uint32_t(B[std::size_t(k) * p + j]);
+    return C;
+}
+
+bool check(const char* name, const std::vector<int>& C, const std::vector<std::uint32_t>& expected)
+{
+    for (std::size_t i = 0; i < C.size(); i++)
+        if (std::uint32_t(C[i]) != expected[i])
+        {
+            std::cerr << name << ": element " << i << " is " << C[i] << ", expected " << int(expected[i]) << '\n';
+            return false;
+        }
+    return true;
+}
+
+// evaluate against the naive sums of products, with tiles that don't divide C, for the products subtracted
+// through the scratch tile and for C being a term of its own expression
+int main()
+{
+    constexpr int n = 50, m = 37, p = 43, tile_size = 16;
+    MatrixMultiplier multiplier = MatrixMultiplier::hybrid_multiplier(n, m, p);
+
+    std::vector<int> A(n * m), B(m * p), D(n * m), E(m * p), F(n * p), start(n * p);
+    randomFill(A, 1, 0, -100, 100);
+    randomFill(B, 1, 1, -100, 100);
+    randomFill(D, 1, 2, -100, 100);
+    randomFill(E, 1, 3, -100, 100);
+    randomFill(F, 1, 4, -100, 100);
+    randomFill(start, 1, 5, -100, 100);
+    MatrixView vA(A, m), vB(B, p), vD(D, m), vE(E, p), vF(F, p);
+
+    std::vector<std::uint32_t> AB = naiveProduct(A, B, n, m, p), DE = naiveProduct(D, E, n, m, p);
+    auto combine = [&](auto element)
+    {
+        std::vector<std::uint32_t> result(std::size_t(n) * p);
+        for (std::size_t i = 0; i < result.size(); i++)
+            result[i] = element(i);
+        return result;
+    };
+
+    bool ok = true;
+    std::vector<int> C;
+
+    C = start;
+    evaluate(lazy(vA) * lazy(vB) - lazy(vD) * lazy(vE) + lazy(vF), MatrixView(C, p), MatMulMode::Overwrite, multiplier, tile_size);
+    ok &= check("C = A * B - D * E + F", C, combine([&](std::size_t i) { return AB[i] - DE[i] + std::uint32_t(F[i]); }));
+
+    C = start;
+    evaluate(lazy(vA) * lazy(vB) - lazy(vD) * lazy(vE), MatrixView(C, p), MatMulMode::Add, multiplier, tile_size);
+    ok &= check("C += A * B - D * E", C, combine([&](std::size_t i) { return std::uint32_t(start[i]) + AB[i] - DE[i]; }));
+
+    // Subtracted before anything is written to the tile
+    C = start;
+    evaluate(-(lazy(vD) * lazy(vE)) + lazy(vA) * lazy(vB), MatrixView(C, p), MatMulMode::Overwrite, multiplier, tile_size);
+    ok &= check("C = -D * E + A * B", C, combine([&](std::size_t i) { return AB[i] - DE[i]; }));
+
+    C = start;
+    evaluate(lazy(vA) * lazy(vB) + lazy(MatrixView(C, p)), MatrixView(C, p), MatMulMode::Overwrite, multiplier, tile_size);
+    ok &= check("C = A * B + C", C, combine([&](std::size_t i) { return AB[i] + std::uint32_t(start[i]); }));
+
+    C = start;
+    evaluate(lazy(vA) * lazy(vB) - lazy(MatrixView(C, p)), MatrixView(C, p), MatMulMode::Add, multiplier, tile_size);
+    ok &= check("C += A * B - C", C, combine([&](std::size_t i) { return AB[i]; }));
+
+    return ok ? 0 : 1;
+}
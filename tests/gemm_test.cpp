@@ -0,0 +1,54 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "../include/gemm.hpp"
+#include "../include/MatrixMultiplier.hpp"
+#include "../include/random_matrix.hpp"
+
+// gemm against epilogue(alpha * A * B + beta * C) computed naively, for scalars that take the scaling paths
+// (not only 0 and 1) and for a composed epilogue that depends on the column, with tiles that don't divide C
+int main()
+{
+    constexpr int n = 45, m = 37, p = 51, tile_size = 16;
+    MatrixMultiplier multiplier = MatrixMultiplier::hybrid_multiplier(n, m, p);
+
+    std::vector<int> A(n * m), B(m * p), start(n * p), bias(p);
+    randomFill(A, 1, 0, -100, 100);
+    randomFill(B, 1, 1, -100, 100);
+    randomFill(start, 1, 2, -100, 100);
+    randomFill(bias, 1, 3, -1000, 1000);
+
+    bool ok = true;
+    auto check = [&](int alpha, int beta, auto epilogue, const char* epilogue_name)
+    {
+        std::vector<int> C = start;
+        gemm(multiplier, alpha, MatrixView(A, m), MatrixView(B, p), beta, MatrixView(C, p), epilogue, tile_size);
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < p; j++)
+            {
+                std::uint32_t product = 0;
+                for (int k = 0; k < m; k++)
+                    product += std::uint32_t(A[i * m + k]) * std::uint32_t(B[k * p + j]);
+                int expected = epilogue(int(std::uint32_t(alpha) * product + std::uint32_t(beta) * std::uint32_t(start[i * p + j])), i, j);
+                if (C[i * p + j] != expected)
+                {
+                    std::cerr << "alpha " << alpha << ", beta " << beta << ", " << epilogue_name << ": C(" << i << ", " << j << ") is "
+                              << C[i * p + j] << ", expected " << expected << '\n';
+                    ok = false;
+                    return;
+                }
+            }
+    };
+
+    for (int alpha : {3, -2, 1, 0})
+        for (int beta : {2, -1, 1, 0})
+            check(alpha, beta, epilogue::Identity{}, "no epilogue");
+
+    auto composed = epilogue::compose(epilogue::Bias{bias}, epilogue::Relu{}, epilogue::Requantize{3, 12, -5});
+    for (int alpha : {3, -2, 1})
+        for (int beta : {2, -1, 0})
+            check(alpha, beta, composed, "bias, relu and requantize");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include <cstdint>
+#include <climits>
+#include <iostream>
+#include <vector>
+#include "../include/modular.hpp"
+#include "../include/random_matrix.hpp"
+
+// modularMatMul and wideMatMul against 128 bit references, in both modes and on several threads: moduli up to
+// 2^31 - 1 (where the accumulators are reduced every few products), operands over the whole int range and
+// starting values of C that are negative
+int main()
+{
+    bool ok = true;
+    constexpr int n = 23, m = 301, p = 37;
+    std::vector<int> A(n * m), B(m * p), start(n * p);
+    randomFill(A, 1, 0, INT_MIN, INT_MAX);
+    randomFill(B, 1, 1, INT_MIN, INT_MAX);
+    randomFill(start, 1, 2, INT_MIN, INT_MAX);
+    A[0] = INT_MIN;
+    B[0] = INT_MIN;
+    A[1] = INT_MAX;
+
+    auto residue = [](__int128 x, std::uint32_t modulus) { return std::int64_t((x % modulus + modulus) % modulus); };
+    for (std::uint32_t modulus : {1u, 2u, 97u, 65521u, 65537u, 1000000007u, 2147483629u, 2147483647u})
+        for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+            for (int threads : {1, 3})
+            {
+                std::vector<int> C = start;
+                modularMatMul(MatrixView(A, m), MatrixView(B, p), MatrixView(C, p), modulus, mode, threads);
+                for (int i = 0; i < n && ok; i++)
+                    for (int j = 0; j < p && ok; j++)
+                    {
+                        __int128 sum = mode == MatMulMode::Add ? start[i * p + j] : 0;
+                        for (int k = 0; k < m; k++)
+                            sum += __int128(std::int64_t(A[i * m + k]) * B[k * p + j]);
+                        std::int64_t expected = residue(sum, modulus);
+                        if (C[i * p + j] != expected)
+                        {
+                            std::cerr << "modulus " << modulus << (mode == MatMulMode::Add ? " add" : " overwrite") << " threads " << threads
+                                      << ": C(" << i << ", " << j << ") is " << C[i * p + j] << ", expected " << expected << '\n';
+                            ok = false;
+                        }
+                    }
+            }
+
+    // Exact while the partial sums fit in 64 bits: m products of operands below 2^30 in magnitude sum to below 2^63
+    constexpr int wide_m = 7;
+    std::vector<int> wide_A(n * wide_m), wide_B(wide_m * p);
+    randomFill(wide_A, 1, 3, -(1 << 30), 1 << 30);
+    randomFill(wide_B, 1, 4, -(1 << 30), 1 << 30);
+    std::vector<std::int64_t> wide_start(n * p);
+    for (int i = 0; i < n * p; i++)
+        wide_start[i] = std::int64_t(start[i]) << 20;
+    for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+        for (int threads : {1, 3})
+        {
+            std::vector<std::int64_t> C = wide_start;
+            wideMatMul(MatrixView(wide_A, wide_m), MatrixView(wide_B, p), WideMatrixView(C, p), mode, threads);
+            for (int i = 0; i < n && ok; i++)
+                for (int j = 0; j < p && ok; j++)
+                {
+                    __int128 expected = mode == MatMulMode::Add ? wide_start[i * p + j] : 0;
+                    for (int k = 0; k < wide_m; k++)
+                        expected += __int128(wide_A[i * wide_m + k]) * wide_B[k * p + j];
+                    if (C[i * p + j] != expected)
+                    {
+                        std::cerr << "wide" << (mode == MatMulMode::Add ? " add" : " overwrite") << " threads " << threads
+                                  << ": C(" << i << ", " << j << ") is " << C[i * p + j] << ", expected " << std::int64_t(expected) << '\n';
+                        ok = false;
+                    }
+                }
+        }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "../include/PackedMatrix.hpp"
+#include "../include/MatrixMultiplier.hpp"
+#include "../include/random_matrix.hpp"
+
+// Products with a packed B against naive ones, in both modes, with n, m and p that aren't multiples of the
+// block size (so the last blocks are partial) and with A and C as views into larger matrices
+int main()
+{
+    bool ok = true;
+    struct Case { int n, m, p, block_size; };
+    for (auto [n, m, p, block_size] : {Case{70, 45, 53, 16}, Case{100, 33, 17, 32}, Case{5, 64, 40, 64}, Case{37, 7, 90, 8}, Case{20, 0, 13, 16}})
+    {
+        MatrixMultiplier multiplier = MatrixMultiplier::hybrid_multiplier(n, std::max(m, 1), p);
+
+        // A and C start at row 3, column 2 of larger matrices
+        constexpr int offset_row = 3, offset_col = 2;
+        int A_row_size = m + 5, C_row_size = p + 4;
+        std::vector<int> A_data((n + 6) * A_row_size), B(m * p), C_data((n + 6) * C_row_size);
+        randomFill(A_data, 1, 0, -100, 100);
+        randomFill(B, 1, 1, -100, 100);
+        randomFill(C_data, 1, 2, -100, 100);
+        MatrixView A = MatrixView(A_data, A_row_size).getSubMatrix(offset_row, offset_row + n, offset_col, offset_col + m);
+        PackedMatrix packed(MatrixView(std::span<int>(B), p, 0, m, 0, p), block_size);
+        std::vector<int> start = C_data;
+
+        for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+        {
+            C_data = start;
+            MatrixView C = MatrixView(C_data, C_row_size).getSubMatrix(offset_row, offset_row + n, offset_col, offset_col + p);
+            multiplier(A, packed, C, mode);
+
+            for (int i = 0; i < n + 6 && ok; i++)
+                for (int j = 0; j < C_row_size && ok; j++)
+                {
+                    int at = i * C_row_size + j;
+                    std::uint32_t expected = std::uint32_t(start[at]);
+                    bool inside = i >= offset_row && i < offset_row + n && j >= offset_col && j < offset_col + p;
+                    if (inside)
+                    {
+                        if (mode == MatMulMode::Overwrite) expected = 0;
+                        for (int k = 0; k < m; k++)
+                            expected += std::uint32_t(A(i - offset_row, k)) * std::uint32_t(B[k * p + j - offset_col]);
+                    }
+                    if (std::uint32_t(C_data[at]) != expected)
+                    {
+                        std::cerr << n << 'x' << m << 'x' << p << " block " << block_size << (mode == MatMulMode::Add ? " add" : " overwrite")
+                                  << ": element (" << i << ", " << j << ") of the matrix C is part of is " << C_data[at]
+                                  << ", expected " << int(expected) << '\n';
+                        ok = false;
+                    }
+                }
+        }
+    }
+    return ok ? 0 : 1;
+}
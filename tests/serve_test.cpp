@@ -0,0 +1,150 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../include/serve.hpp"
+#include "../include/random_matrix.hpp"
+
+std::vector<std::uint32_t> naiveProduct(MatrixView A, MatrixView B)
+{
+    int n = A.row_count(), m = A.col_count(), p = B.col_count();
+    std::vector<std::uint32_t> C(std::size_t(n) * p, 0);
+    for (int i = 0; i < n; i++)
+        for (int k = 0; k < m; k++)
+            for (int j = 0; j < p; j++)
+                C[std::size_t(i) * p + j] += std::uint32_t(A(i, k)) * std::uint32_t(B(k, j));
+    return C;
+}
+
+bool equal(MatrixView C, const std::vector<std::uint32_t>& expected)
+{
+    for (int i = 0; i < C.row_count(); i++)
+        for (int j = 0; j < C.col_count(); j++)
+            if (std::uint32_t(C(i, j)) != expected[std::size_t(i) * C.col_count() + j])
+                return false;
+    return true;
+}
+
+// A stream of inline and file jobs through JobServer::serve, from a file to a file: every job gets its reply,
+// with the right C, the file jobs (one with its B packed on its second use) write theirs, and a job with a
+// missing file gets an error without stopping the others
+int main()
+{
+    char directory_template[] = "/tmp/serve_testXXXXXX";
+    if (!mkdtemp(directory_template))
+        return 1;
+    std::string directory = directory_template;
+    auto path = [&](const char* name) { return directory + "/" + name; };
+
+    bool ok = true;
+    {
+        auto A_file = MappedMatrix::create(path("A.mat"), 40, 30);
+        auto B_file = MappedMatrix::create(path("B.mat"), 30, 25);
+        randomFill(A_file->data(), 1, 0, -100, 100);
+        randomFill(B_file->data(), 1, 1, -100, 100);
+        A_file->flush();
+        B_file->flush();
+    }
+
+    struct Inline { std::string id; int n, m, p; std::vector<int> A, B; };
+    std::vector<Inline> inline_jobs{{"one", 2, 3, 4}, {"two", 17, 9, 1}, {"three", 33, 40, 21}};
+    std::string input;
+    for (std::size_t i = 0; i < inline_jobs.size(); i++)
+    {
+        auto& job = inline_jobs[i];
+        job.A.resize(job.n * job.m);
+        job.B.resize(job.m * job.p);
+        randomFill(job.A, 2, 2 * i, -100, 100);
+        randomFill(job.B, 2, 2 * i + 1, -100, 100);
+        input += std::format("mul {} {}_{}_{}\n", job.id, job.n, job.m, job.p);
+        input.append(reinterpret_cast<const char*>(job.A.data()), job.A.size() * sizeof(int));
+        input.append(reinterpret_cast<const char*>(job.B.data()), job.B.size() * sizeof(int));
+    }
+    input += std::format("mul file {} {} {}\n", path("A.mat"), path("B.mat"), path("C.mat"));
+    input += std::format("mul packed {} {} {}\n", path("A.mat"), path("B.mat"), path("C2.mat"));
+    input += std::format("mul missing {} {} {}\n", path("none.mat"), path("B.mat"), path("C3.mat"));
+    input += "quit\n";
+
+    int in = open(path("in").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    int out = open(path("out").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (in < 0 || out < 0 || write(in, input.data(), input.size()) != ssize_t(input.size()) || lseek(in, 0, SEEK_SET) != 0)
+        return 1;
+
+    {
+        JobServer server([](int N, int M, int P) { return MatrixMultiplier::hybrid_multiplier(N, M, P); }, 2, std::size_t(1) << 20);
+        server.serve(in, out);
+    }
+
+    std::string output(std::size_t(lseek(out, 0, SEEK_END)), '\0');
+    if (pread(out, output.data(), output.size(), 0) != ssize_t(output.size()))
+        return 1;
+    close(in);
+    close(out);
+
+    // Replies in any order, inline ones followed by C
+    std::map<std::string, std::string> replies;
+    std::map<std::string, std::vector<int>> results;
+    for (std::size_t at = 0; at < output.size();)
+    {
+        std::size_t end = output.find('\n', at);
+        if (end == std::string::npos)
+            break;
+        std::istringstream words(output.substr(at, end - at));
+        at = end + 1;
+        std::string status, id, shape;
+        words >> status >> id >> shape;
+        replies[id] = status + " " + shape;
+        for (auto& job : inline_jobs)
+            if (job.id == id && status == "ok")
+            {
+                std::vector<int>& C = results[id];
+                C.resize(job.n * job.p);
+                std::memcpy(C.data(), output.data() + at, std::min(C.size() * sizeof(int), output.size() - at));
+                at += C.size() * sizeof(int);
+            }
+    }
+
+    for (auto& job : inline_jobs)
+    {
+        std::string expected = std::format("ok {}_{}_{}", job.n, job.m, job.p);
+        if (replies[job.id] != expected || !equal(MatrixView(results[job.id], job.p), naiveProduct(MatrixView(job.A, job.m), MatrixView(job.B, job.p))))
+        {
+            std::cerr << "job " << job.id << ": reply '" << replies[job.id] << "', expected '" << expected << "' and its product\n";
+            ok = false;
+        }
+    }
+
+    auto A_file = MappedMatrix::open(path("A.mat"));
+    auto B_file = MappedMatrix::open(path("B.mat"));
+    auto expected = naiveProduct(A_file->view(), B_file->view());
+    for (const char* id : {"file", "packed"})
+    {
+        auto C_file = MappedMatrix::open(path(std::strcmp(id, "file") == 0 ? "C.mat" : "C2.mat"));
+        if (replies[id] != "ok 40_30_25" || !C_file || !equal(C_file->view(), expected))
+        {
+            std::cerr << "job " << id << ": reply '" << replies[id] << "', expected 'ok 40_30_25' and its product in the file\n";
+            ok = false;
+        }
+    }
+    if (replies["missing"].rfind("error", 0) != 0)
+    {
+        std::cerr << "job missing: reply '" << replies["missing"] << "', expected an error\n";
+        ok = false;
+    }
+    if (replies.size() != inline_jobs.size() + 3)
+    {
+        std::cerr << replies.size() << " replies, expected " << inline_jobs.size() + 3 << '\n';
+        ok = false;
+    }
+
+    for (const char* name : {"A.mat", "B.mat", "C.mat", "C2.mat", "in", "out"})
+        std::remove(path(name).c_str());
+    rmdir(directory.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../include/sparsity.hpp"
+#include "../include/MatrixMultiplier.hpp"
+#include "../include/random_matrix.hpp"
+
+// Products of indexed operands with zero tiles against naive ones, for the strategies that skip zero parts
+// (blocked, recursive, multithreaded and the hybrid chains), in both modes. The zero regions line up with the
+// blocks and index tiles or cut across them, and cover whole bands of C so that blocks of C get no product at
+// all and must still be cleared in Overwrite mode.
+int main()
+{
+    bool ok = true;
+    constexpr int n = 200, m = 180, p = 150;
+
+    struct Region { int row_begin, row_end, col_begin, col_end; };
+    struct Case { std::string name; std::vector<Region> A_zero, B_zero; int tile_size; };
+    std::vector<Case> cases{
+        {"aligned row band of A", {{64, 128, 0, m}}, {}, 32},
+        {"aligned column band of B", {}, {{0, m, 32, 96}}, 32},
+        {"unaligned regions", {{10, 75, 20, 100}, {150, 200, 0, m}}, {{0, 50, 0, p}, {100, 170, 70, 150}}, 32},
+        {"tiles across the blocks", {{0, n, 40, 130}}, {{17, 90, 0, p}}, 24},
+        {"zero A", {{0, n, 0, m}}, {}, 32},
+        {"scattered tiles", {}, {}, 16}};
+    for (int t = 0; t < 40; t++) // many 32 x 32 tiles of A and of B, by a fixed pattern, indexed in smaller tiles
+    {
+        int i = t % 7, j = (t / 7 + 2 * t) % 6;
+        cases.back().A_zero.push_back({i * 32, std::min(n, i * 32 + 32), j * 32, std::min(m, j * 32 + 32)});
+        cases.back().B_zero.push_back({j * 32, std::min(m, j * 32 + 32), (t % 5) * 32, std::min(p, (t % 5) * 32 + 32)});
+    }
+
+    auto recurse = [](int n, int m, int p) { return std::min({n, m, p}) > 16; };
+    auto split = [](int n, int m, int p) { return std::int64_t(n) * m * p >= 4096; };
+    std::vector<std::pair<std::string, MatrixMultiplier>> multipliers{
+        {"blocked", MatrixMultiplier::into_blocks_then(64, MatrixMultiplier::naive_cache_friendly_mutliplier)},
+        {"recursive", MatrixMultiplier::recursive_then(recurse, MatrixMultiplier::naive_cache_friendly_mutliplier)},
+        {"multithreaded", MatrixMultiplier::possibly_multithreaded(split, MatrixMultiplier::naive_cache_friendly_mutliplier, 4)},
+        {"hybrid", MatrixMultiplier::hybrid_multiplier(n, m, p)},
+        {"multithreaded hybrid", MatrixMultiplier::multithreaded_hybrid_multiplier(n, m, p, 4)}};
+
+    for (std::uint64_t c = 0; c < cases.size(); c++)
+    {
+        auto& [name, A_zero, B_zero, tile_size] = cases[c];
+        std::vector<int> A(n * m), B(m * p), start(n * p);
+        randomFill(A, 1, 3 * c, -100, 100);
+        randomFill(B, 1, 3 * c + 1, -100, 100);
+        randomFill(start, 1, 3 * c + 2, -100, 100);
+        for (auto [r0, r1, c0, c1] : A_zero) MatrixView(A, m).getSubMatrix(r0, r1, c0, c1).clear();
+        for (auto [r0, r1, c0, c1] : B_zero) MatrixView(B, p).getSubMatrix(r0, r1, c0, c1).clear();
+
+        std::vector<std::uint32_t> product(n * p, 0);
+        for (int i = 0; i < n; i++)
+            for (int k = 0; k < m; k++)
+                for (int j = 0; j < p; j++)
+                    product[i * p + j] += std::uint32_t(A[i * m + k]) * std::uint32_t(B[k * p + j]);
+
+        sparsity::Index A_index(MatrixView(A, m), tile_size), B_index(MatrixView(B, p), tile_size);
+        for (auto& [multiplier_name, multiplier] : multipliers)
+            for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+            {
+                std::vector<int> C = start;
+                multiplier(MatrixView(A, m), MatrixView(B, p), MatrixView(C, p), mode);
+                for (int i = 0; i < n * p; i++)
+                {
+                    std::uint32_t expected = product[i] + (mode == MatMulMode::Add ? std::uint32_t(start[i]) : 0);
+                    if (std::uint32_t(C[i]) != expected)
+                    {
+                        std::cerr << name << ", " << multiplier_name << (mode == MatMulMode::Add ? " add" : " overwrite") << ": C("
+                                  << i / p << ", " << i % p << ") is " << C[i] << ", expected " << int(expected) << '\n';
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+    }
+
+    return ok ? 0 : 1;
+}
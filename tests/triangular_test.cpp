@@ -0,0 +1,88 @@
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "../include/triangular.hpp"
+#include "../include/MatrixMultiplier.hpp"
+#include "../include/random_matrix.hpp"
+
+// syrk and trmm against the full naive products, for both triangles, both modes and several thread counts, on
+// sizes with one and with many blocks. The triangle syrk doesn't compute must be left as it was.
+int main()
+{
+    bool ok = true;
+    auto fail = [&](const char* name, int n, Triangle triangle, MatMulMode mode, int threads, int i, int j, int got, int expected)
+    {
+        std::cerr << name << " n " << n << (triangle == Triangle::Lower ? " lower" : " upper") << (mode == MatMulMode::Add ? " add" : " overwrite")
+                  << " threads " << threads << ": C(" << i << ", " << j << ") is " << got << ", expected " << expected << '\n';
+        ok = false;
+    };
+
+    struct Sizes { int n, k; };
+    for (auto [n, k] : {Sizes{20, 9}, Sizes{300, 17}, Sizes{517, 40}, Sizes{130, 0}})
+    {
+        MatrixMultiplier multiplier = MatrixMultiplier::hybrid_multiplier(n, std::max(k, 1), n);
+        std::vector<int> A(std::size_t(n) * k), start(std::size_t(n) * n);
+        randomFill(A, 1, 0, -100, 100);
+        randomFill(start, 1, 1, -100, 100);
+
+        std::vector<std::uint32_t> full(std::size_t(n) * n, 0);
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++)
+                for (int l = 0; l < k; l++)
+                    full[std::size_t(i) * n + j] += std::uint32_t(A[std::size_t(i) * k + l]) * std::uint32_t(A[std::size_t(j) * k + l]);
+
+        for (Triangle triangle : {Triangle::Lower, Triangle::Upper})
+            for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+                for (int threads : {1, 3, 8})
+                {
+                    std::vector<int> C = start;
+                    syrk(multiplier, MatrixView(std::span<int>(A), k, 0, n, 0, k), MatrixView(C, n), mode, triangle, threads);
+                    for (int i = 0; i < n && ok; i++)
+                        for (int j = 0; j < n && ok; j++)
+                        {
+                            std::size_t at = std::size_t(i) * n + j;
+                            int expected = !detail::in_triangle(triangle, i, j) ? start[at]
+                                         : mode == MatMulMode::Add ? int(std::uint32_t(start[at]) + full[at]) : int(full[at]);
+                            if (C[at] != expected)
+                                fail("syrk", n, triangle, mode, threads, i, j, C[at], expected);
+                        }
+                }
+    }
+
+    for (auto [n, p] : {Sizes{20, 9}, Sizes{150, 90}, Sizes{333, 130}})
+    {
+        MatrixMultiplier multiplier = MatrixMultiplier::hybrid_multiplier(n, n, p);
+        std::vector<int> T(std::size_t(n) * n), B(std::size_t(n) * p), start(std::size_t(n) * p);
+        randomFill(T, 1, 2, -100, 100);
+        randomFill(B, 1, 3, -100, 100);
+        randomFill(start, 1, 4, -100, 100);
+
+        for (Triangle triangle : {Triangle::Lower, Triangle::Upper})
+        {
+            std::vector<std::uint32_t> full(std::size_t(n) * p, 0);
+            for (int i = 0; i < n; i++)
+                for (int l = 0; l < n; l++)
+                    if (detail::in_triangle(triangle, i, l))
+                        for (int j = 0; j < p; j++)
+                            full[std::size_t(i) * p + j] += std::uint32_t(T[std::size_t(i) * n + l]) * std::uint32_t(B[std::size_t(l) * p + j]);
+
+            for (MatMulMode mode : {MatMulMode::Overwrite, MatMulMode::Add})
+                for (int threads : {1, 3, 8})
+                {
+                    std::vector<int> C = start;
+                    trmm(multiplier, triangle, MatrixView(T, n), MatrixView(B, p), MatrixView(C, p), mode, threads);
+                    for (int i = 0; i < n && ok; i++)
+                        for (int j = 0; j < p && ok; j++)
+                        {
+                            std::size_t at = std::size_t(i) * p + j;
+                            int expected = mode == MatMulMode::Add ? int(std::uint32_t(start[at]) + full[at]) : int(full[at]);
+                            if (C[at] != expected)
+                                fail("trmm", n, triangle, mode, threads, i, j, C[at], expected);
+                        }
+                }
+        }
+    }
+
+    return ok ? 0 : 1;
+}